@@ -0,0 +1,47 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include <limits>
+#include "Eigen/Dense"
+
+struct AABB {
+    Eigen::Vector3d min = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector3d max = Eigen::Vector3d::Constant(std::numeric_limits<double>::lowest());
+
+    void reset() {
+        min.setConstant(std::numeric_limits<double>::max());
+        max.setConstant(std::numeric_limits<double>::lowest());
+    }
+
+    void extend(const Eigen::Vector3d &p) {
+        min = min.cwiseMin(p);
+        max = max.cwiseMax(p);
+    }
+
+    void extend(const AABB &other) {
+        min = min.cwiseMin(other.min);
+        max = max.cwiseMax(other.max);
+    }
+
+    AABB expanded(double amount) const {
+        AABB box;
+        box.min = min.array() - amount;
+        box.max = max.array() + amount;
+        return box;
+    }
+
+    bool contains(const Eigen::Vector3d &p) const {
+        return (p.array() >= min.array()).all() && (p.array() <= max.array()).all();
+    }
+
+    bool overlaps(const AABB &other) const {
+        return (min.array() <= other.max.array()).all() && (other.min.array() <= max.array()).all();
+    }
+
+    // distance from p to the closest point of the box, 0 if p is inside
+    double distance(const Eigen::Vector3d &p) const {
+        return (min - p).cwiseMax(p - max).cwiseMax(0.0).norm();
+    }
+};
+
+#endif // AABB_H
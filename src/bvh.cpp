@@ -0,0 +1,73 @@
+#include "bvh.h"
+#include <algorithm>
+
+using namespace Eigen;
+
+static const int LEAF_SIZE = 4;
+
+BVH::BVH() {}
+
+void BVH::build(const std::vector<AABB> &boxes) {
+    m_nodes.clear();
+    m_primitives.resize(boxes.size());
+    for(int i = 0; i < boxes.size(); i++) {
+        m_primitives[i] = i;
+    }
+
+    if(boxes.empty()) return;
+
+    m_nodes.reserve(2*boxes.size()/LEAF_SIZE + 1);
+    buildNode(boxes, 0, boxes.size());
+}
+
+// top down, splitting at the median centroid along the longest axis. children always come after
+// their parent in m_nodes, so refit can run back to front
+int BVH::buildNode(const std::vector<AABB> &boxes, int first, int count) {
+    int index = m_nodes.size();
+    m_nodes.push_back(BVHNode());
+
+    AABB box;
+    AABB centroids;
+    for(int i = first; i < first + count; i++) {
+        const AABB &b = boxes[m_primitives[i]];
+        box.extend(b);
+        centroids.extend(Vector3d((b.min + b.max)/2));
+    }
+    m_nodes[index].box = box;
+
+    if(count <= LEAF_SIZE) {
+        m_nodes[index].first = first;
+        m_nodes[index].count = count;
+        return index;
+    }
+
+    int axis;
+    (centroids.max - centroids.min).maxCoeff(&axis);
+
+    int half = count/2;
+    std::nth_element(m_primitives.begin() + first, m_primitives.begin() + first + half, m_primitives.begin() + first + count, [&](int a, int b) {
+        return boxes[a].min[axis] + boxes[a].max[axis] < boxes[b].min[axis] + boxes[b].max[axis];
+    });
+
+    int left = buildNode(boxes, first, half);
+    int right = buildNode(boxes, first + half, count - half);
+    m_nodes[index].left = left;
+    m_nodes[index].right = right;
+    m_nodes[index].count = 0;
+    return index;
+}
+
+void BVH::refit(const std::vector<AABB> &boxes) {
+    for(int i = m_nodes.size() - 1; i >= 0; i--) {
+        BVHNode &node = m_nodes[i];
+        node.box.reset();
+        if(node.count > 0) {
+            for(int j = node.first; j < node.first + node.count; j++) {
+                node.box.extend(boxes[m_primitives[j]]);
+            }
+        } else {
+            node.box.extend(m_nodes[node.left].box);
+            node.box.extend(m_nodes[node.right].box);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <vector>
+#include "aabb.h"
+
+// bounding volume hierarchy over a fixed set of primitives given by their boxes. the tree
+// topology is built once, after that the primitives may move and the boxes are just refit
+class BVH
+{
+public:
+    BVH();
+
+    void build(const std::vector<AABB> &boxes);
+    void refit(const std::vector<AABB> &boxes);
+
+    const AABB &getBounds() const {return m_nodes[0].box;}
+    bool empty() const {return m_nodes.empty();}
+
+    // calls visit(primitive) for every primitive whose box overlaps box
+    template<typename F>
+    void query(const AABB &box, F &&visit) const {
+        if(m_nodes.empty()) return;
+
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while(top > 0) {
+            const BVHNode &node = m_nodes[stack[--top]];
+            if(!node.box.overlaps(box)) continue;
+
+            if(node.count > 0) {
+                for(int i = node.first; i < node.first + node.count; i++) {
+                    visit(m_primitives[i]);
+                }
+            } else {
+                stack[top++] = node.left;
+                stack[top++] = node.right;
+            }
+        }
+    }
+
+private:
+    struct BVHNode {
+        AABB box;
+        int left, right;   // children, for inner nodes
+        int first, count;  // range in m_primitives, count > 0 only for leaves
+    };
+
+    int buildNode(const std::vector<AABB> &boxes, int first, int count);
+
+    std::vector<BVHNode> m_nodes;
+    std::vector<int> m_primitives;
+};
+
+#endif // BVH_H
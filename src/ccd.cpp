@@ -0,0 +1,170 @@
+#include "ccd.h"
+#include <algorithm>
+
+using namespace Eigen;
+
+// the four points are coplanar exactly when det(x1, x2, x3) = 0, with x_i = x_i0 + t*v_i.
+// det is linear in each column, which gives the cubic's coefficients directly
+static void coplanarityCubic(const Vector3d &x10, const Vector3d &v1,
+                             const Vector3d &x20, const Vector3d &v2,
+                             const Vector3d &x30, const Vector3d &v3,
+                             double coeffs[4]) {
+    auto det = [](const Vector3d &a, const Vector3d &b, const Vector3d &c) {return a.dot(b.cross(c));};
+
+    coeffs[0] = det(x10, x20, x30);
+    coeffs[1] = det(v1, x20, x30) + det(x10, v2, x30) + det(x10, x20, v3);
+    coeffs[2] = det(x10, v2, v3) + det(v1, x20, v3) + det(v1, v2, x30);
+    coeffs[3] = det(v1, v2, v3);
+}
+
+static double evalCubic(const double c[4], double t) {
+    return ((c[3]*t + c[2])*t + c[1])*t + c[0];
+}
+
+// roots in [0, 1] where the cubic changes sign, ascending. if falling is set only roots where it goes
+// from positive to non-positive are reported
+static int cubicRoots(const double c[4], bool falling, double roots[3]) {
+    // split [0, 1] at the extrema so the cubic is monotone on each piece
+    double breaks[4];
+    int n_breaks = 0;
+    breaks[n_breaks++] = 0;
+
+    double a = 3*c[3], b = 2*c[2], d = c[1];
+    if(std::abs(a) > 1e-300) {
+        double disc = b*b - 4*a*d;
+        if(disc > 0) {
+            double sq = std::sqrt(disc);
+            double e1 = (-b - sq)/(2*a);
+            double e2 = (-b + sq)/(2*a);
+            if(e1 > e2) std::swap(e1, e2);
+            if(e1 > 0 && e1 < 1) breaks[n_breaks++] = e1;
+            if(e2 > 0 && e2 < 1) breaks[n_breaks++] = e2;
+        }
+    } else if(std::abs(b) > 1e-300) {
+        double e = -d/b;
+        if(e > 0 && e < 1) breaks[n_breaks++] = e;
+    }
+    breaks[n_breaks++] = 1;
+
+    int n_roots = 0;
+    for(int i = 0; i + 1 < n_breaks; i++) {
+        double lo = breaks[i], hi = breaks[i+1];
+        double f_lo = evalCubic(c, lo), f_hi = evalCubic(c, hi);
+
+        if(!(f_lo > 0 && f_hi <= 0) && (falling || !(f_lo < 0 && f_hi >= 0))) continue;
+
+        for(int it = 0; it < 60 && hi - lo > 1e-12; it++) {
+            double mid = (lo + hi)/2;
+            double f_mid = evalCubic(c, mid);
+            if((f_mid > 0) == (f_lo > 0)) {
+                lo = mid;
+                f_lo = f_mid;
+            } else {
+                hi = mid;
+            }
+        }
+        roots[n_roots++] = hi;
+    }
+
+    return n_roots;
+}
+
+static Vector3d lerp(const Vector3d &x0, const Vector3d &x1, double t) {
+    return x0 + t*(x1 - x0);
+}
+
+double vertexTriangleImpact(const Vector3d &p0, const Vector3d &p1,
+                            const Vector3d &a0, const Vector3d &a1,
+                            const Vector3d &b0, const Vector3d &b1,
+                            const Vector3d &c0, const Vector3d &c1,
+                            Vector3d &normal) {
+    double coeffs[4];
+    coplanarityCubic(b0 - a0, (b1 - a1) - (b0 - a0),
+                     c0 - a0, (c1 - a1) - (c0 - a0),
+                     p0 - a0, (p1 - a1) - (p0 - a0), coeffs);
+
+    double roots[3];
+    int n_roots = cubicRoots(coeffs, true, roots);
+    for(int i = 0; i < n_roots; i++) {
+        double t = roots[i];
+        Vector3d a = lerp(a0, a1, t);
+        Vector3d v0 = lerp(c0, c1, t) - a;
+        Vector3d v1 = lerp(b0, b1, t) - a;
+        Vector3d v2 = lerp(p0, p1, t) - a;
+
+        double d00 = v0.dot(v0);
+        double d01 = v0.dot(v1);
+        double d11 = v1.dot(v1);
+        double d20 = v2.dot(v0);
+        double d21 = v2.dot(v1);
+
+        double denom = d00*d11-d01*d01;
+        if(denom <= 0) continue;
+
+        double u = (d11*d20-d01*d21)/denom;
+        double v = (d00*d21-d01*d20)/denom;
+
+        const double tol = 1e-9;
+        if(u >= -tol && v >= -tol && u + v <= 1 + tol) {
+            normal = v1.cross(v0).normalized();
+            return t;
+        }
+    }
+
+    return NO_IMPACT;
+}
+
+double edgeEdgeImpact(const Vector3d &p0, const Vector3d &p1,
+                      const Vector3d &q0, const Vector3d &q1,
+                      const Vector3d &r0, const Vector3d &r1,
+                      const Vector3d &s0, const Vector3d &s1,
+                      const Vector3d &o0, const Vector3d &o1,
+                      Vector3d &normal) {
+    double coeffs[4];
+    coplanarityCubic(q0 - p0, (q1 - p1) - (q0 - p0),
+                     r0 - p0, (r1 - p1) - (r0 - p0),
+                     s0 - p0, (s1 - p1) - (s0 - p0), coeffs);
+
+    double roots[3];
+    int n_roots = cubicRoots(coeffs, false, roots);
+    for(int i = 0; i < n_roots; i++) {
+        double t = roots[i];
+        Vector3d p = lerp(p0, p1, t);
+        Vector3d d1 = lerp(q0, q1, t) - p;
+        Vector3d r = lerp(r0, r1, t);
+        Vector3d d2 = lerp(s0, s1, t) - r;
+        Vector3d w = p - r;
+
+        // closest points of the two lines, p + u*d1 and r + v*d2
+        double a = d1.dot(d1);
+        double b = d1.dot(d2);
+        double c = d2.dot(d2);
+        double d = d1.dot(w);
+        double e = d2.dot(w);
+        double denom = a*c - b*b;
+
+        // parallel edges are left to the vertex-triangle tests
+        if(denom <= 1e-12*a*c) continue;
+
+        double u = (b*e - c*d)/denom;
+        double v = (a*e - b*d)/denom;
+
+        const double tol = 1e-9;
+        if(u < -tol || u > 1 + tol || v < -tol || v > 1 + tol) continue;
+
+        // coplanar and inside both segments, but make sure the lines really meet there
+        Vector3d gap = (p + u*d1) - (r + v*d2);
+        if(gap.squaredNorm() > 1e-12*std::max(a, c)) continue;
+
+        // and that pq is moving into the triangle there rather than out of it
+        Vector3d n = d2.cross(lerp(o0, o1, t) - r);
+        Vector3d pq_velocity = (1-u)*(p1 - p0) + u*(q1 - q0);
+        Vector3d rs_velocity = (1-v)*(r1 - r0) + v*(s1 - s0);
+        if((pq_velocity - rs_velocity).dot(n) >= 0) continue;
+
+        normal = n.normalized();
+        return t;
+    }
+
+    return NO_IMPACT;
+}
@@ -0,0 +1,29 @@
+#ifndef CCD_H
+#define CCD_H
+
+#include <limits>
+#include "Eigen/Dense"
+
+// continuous collision tests. every point moves linearly from its *0 position at t = 0 to its *1 position at t = 1,
+// and each test returns the first t in [0, 1] of the event, or NO_IMPACT. normal is set to the unit normal of the
+// surface that was hit, at the time of the event
+
+const double NO_IMPACT = std::numeric_limits<double>::infinity();
+
+// point p passing through triangle abc from the side its normal (b-a)x(c-a) points to
+double vertexTriangleImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                            const Eigen::Vector3d &a0, const Eigen::Vector3d &a1,
+                            const Eigen::Vector3d &b0, const Eigen::Vector3d &b1,
+                            const Eigen::Vector3d &c0, const Eigen::Vector3d &c1,
+                            Eigen::Vector3d &normal);
+
+// edge pq passing through edge rs of triangle rso from the side its normal (s-r)x(o-r) points to, that is while pq
+// approaches the triangle along that normal. edges moving away from the surface do not count
+double edgeEdgeImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1,
+                      const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                      const Eigen::Vector3d &r0, const Eigen::Vector3d &r1,
+                      const Eigen::Vector3d &s0, const Eigen::Vector3d &s1,
+                      const Eigen::Vector3d &o0, const Eigen::Vector3d &o1,
+                      Eigen::Vector3d &normal);
+
+#endif // CCD_H
@@ -1,11 +1,13 @@
 #include "collider.h"
+#include "extractfaces.h"
+#include "ccd.h"
 #include <iostream>
 
 using namespace Eigen;
 
-Vector3d normal(const Vector3i &face, std::vector<Vector3d> &vertices) {
-    Vector3d e1 = vertices[face[1]] - vertices[face[0]];
-    Vector3d e2 = vertices[face[2]] - vertices[face[0]];
+Vector3d normal(const Vector3d &A, const Vector3d &B, const Vector3d &C) {
+    Vector3d e1 = B - A;
+    Vector3d e2 = C - A;
     return e1.cross(e2).normalized();
 }
 
@@ -13,87 +15,230 @@ Collider::Collider() {}
 
 Collider::Collider(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &faces, int id, bool is_flat, double collision_penalty, double collision_epsilon) :
     m_id(id),
-    m_is_flat(is_flat),
     m_collision_penalty(collision_penalty),
-    m_collision_epsilon(collision_epsilon)
+    m_collision_epsilon(collision_epsilon),
+    m_vertices(vertices),
+    m_faces(faces),
+    m_is_flat(is_flat)
 {
-    m_max_x = m_max_y = m_max_z = std::numeric_limits<double>::lowest();
-    m_min_x = m_min_y = m_min_z = std::numeric_limits<double>::max();
-
-    for(const Vector3d &v : vertices) {
-        m_vertices.push_back(Vector3d(v));
-        if(v[0] < m_min_x) m_min_x = v[0];
-        if(v[1] < m_min_y) m_min_y = v[1];
-        if(v[2] < m_min_z) m_min_z = v[2];
-
-        if(v[0] > m_max_x) m_max_x = v[0];
-        if(v[1] > m_max_y) m_max_y = v[1];
-        if(v[2] > m_max_z) m_max_z = v[2];
+    // only vertices on a face can ever be hit, so interior nodes are never looked at
+    extractSurfaceVertices(m_faces, m_surface);
+
+    std::vector<int> slot(m_surface.empty() ? 0 : m_surface.back() + 1, -1);
+    for(int i = 0; i < m_surface.size(); i++) {
+        slot[m_surface[i]] = i;
+    }
+    for(const Vector3i &f : m_faces) {
+        m_surface_faces.emplace_back(slot[f[0]], slot[f[1]], slot[f[2]]);
+    }
+
+    update();
+}
+
+void Collider::bindVertices(VertexView view, VertexView velocities) {
+    m_view = view;
+    m_velocities = velocities;
+    m_vertices.clear();
+    m_vertices.shrink_to_fit();
+
+    update();
+}
+
+void Collider::update() {
+    m_bounds.reset();
+    for(int i : m_surface) {
+        m_bounds.extend(vertex(i));
     }
 
-    for(const Vector3i &f : faces) {
-        m_faces.push_back(Vector3i(f));
+    m_normals.resize(m_faces.size());
+    m_face_bounds.resize(m_faces.size());
+    for(int i = 0; i < m_faces.size(); i++) {
+        const Vector3i &f = m_faces[i];
+        m_normals[i] = normal(vertex(f[0]), vertex(f[1]), vertex(f[2]));
 
-        m_normals.push_back(normal(f, m_vertices));
+        m_face_bounds[i].reset();
+        m_face_bounds[i].extend(vertex(f[0]));
+        m_face_bounds[i].extend(vertex(f[1]));
+        m_face_bounds[i].extend(vertex(f[2]));
     }
 }
 
-void Collider::setVertices(const std::vector<Eigen::Vector3d> &vertices) {
-    m_vertices.clear();
-    m_max_x = m_max_y = m_max_z = std::numeric_limits<double>::lowest();
-    m_min_x = m_min_y = m_min_z = std::numeric_limits<double>::max();
-    for(const Vector3d &v : vertices) {
-        m_vertices.push_back(Vector3d(v));
-        if(v[0] < m_min_x) m_min_x = v[0];
-        if(v[1] < m_min_y) m_min_y = v[1];
-        if(v[2] < m_min_z) m_min_z = v[2];
-
-        if(v[0] > m_max_x) m_max_x = v[0];
-        if(v[1] > m_max_y) m_max_y = v[1];
-        if(v[2] > m_max_z) m_max_z = v[2];
+bool inContactLayer(const Vector3d &point, const Vector3d &A, const Vector3d &B, const Vector3d &C, const Vector3d &normal, double epsilon, double &d, double &u, double &v) {
+    d = (point - A).dot(normal);
+
+    if(d > 0 || std::abs(d) > epsilon) return false;
+
+    Vector3d v0 = C-A;
+    Vector3d v1 = B-A;
+    Vector3d v2 = point - A;
+
+    double d00 = v0.dot(v0);
+    double d01 = v0.dot(v1);
+    double d11 = v1.dot(v1);
+    double d20 = v2.dot(v0);
+    double d21 = v2.dot(v1);
+
+    double denom = d00*d11-d01*d01;
+
+    u = (d11*d20-d01*d21)/denom;
+    v = (d00*d21-d01*d20)/denom;
+
+    return !(u < 0 || v < 0 || u + v > 1);
+}
+
+bool Collider::testFace(int i, const Vector3d &point, double reach, double &d, double &u, double &v) {
+    const Vector3i &face = m_faces[i];
+    return inContactLayer(point, vertex(face[0]), vertex(face[1]), vertex(face[2]), m_normals[i], reach, d, u, v);
+}
+
+bool Collider::detectContact(const Eigen::Vector3d &point, int &face, double &depth, double &clearance) {
+    double d, u, v;
+    if(face >= 0 && testFace(face, point, m_collision_epsilon, d, u, v)) {
+        depth = std::abs(d);
+        clearance = 0;
+        return true;
     }
 
-    m_normals.clear();
-    for(const Vector3i &f : m_faces) {
-        m_normals.push_back(normal(f, m_vertices));
+    // a hit is within epsilon of a face, and every face is inside the bounding box
+    if(!m_is_flat && !m_bounds.contains(point)) {
+        face = -1;
+        clearance = m_bounds.distance(point) - m_collision_epsilon;
+        return false;
+    }
+
+    clearance = std::numeric_limits<double>::max();
+    for(int i = 0; i < m_faces.size(); i++) {
+        if(!testFace(i, point, m_collision_epsilon, d, u, v)) {
+            // the distance to a triangle is at least the distance to its plane and to its box
+            clearance = std::min(clearance, std::max(std::abs(d), m_face_bounds[i].distance(point)) - m_collision_epsilon);
+            continue;
+        }
+
+        face = i;
+        depth = std::abs(d);
+        clearance = 0;
+        return true;
     }
+
+    face = -1;
+    return false;
 }
 
-Vector3d Collider::resolveCollision(Eigen::Vector3d point) {
-    if(!m_is_flat && (point.x() > m_max_x || point.y() > m_max_y || point.z() > m_max_z || point.x() < m_min_x || point.y() < m_min_y || point.z() < m_min_z)) return Vector3d(0,0,0);
+bool Collider::findContact(const Vector3d &point, double reach, double &depth, Vector3d &normal, Vector3d &velocity) {
+    if(!m_is_flat && !m_bounds.contains(point)) return false;
 
+    reach = std::max(reach, m_collision_epsilon);
+    int best = -1;
+    double best_u, best_v;
     for(int i = 0; i < m_faces.size(); i++) {
-        Vector3i face = m_faces[i];
-        Vector3d A, B, C;
-        A = m_vertices[face[0]];
-        B = m_vertices[face[1]];
-        C = m_vertices[face[2]];
-        Vector3d normal = m_normals[i];
+        double d, u, v;
+        if(!testFace(i, point, reach, d, u, v)) continue;
+        if(best >= 0 && -d >= depth) continue;
+
+        best = i;
+        depth = -d;
+        best_u = u;
+        best_v = v;
+    }
+    if(best < 0) return false;
+
+    normal = m_normals[best];
+    if(m_velocities.base) {
+        const Vector3i &face = m_faces[best];
+        velocity = (1-best_u-best_v)*m_velocities[face[0]] + best_v*m_velocities[face[1]] + best_u*m_velocities[face[2]];
+    } else {
+        velocity = Vector3d(0,0,0);
+    }
+    return true;
+}
 
-        double d = (point - A).dot(normal);
+void Collider::computeShell(std::vector<Vector3d> &shell) {
+    shell.assign(m_surface.size(), Vector3d(0,0,0));
+    for(int i = 0; i < m_surface_faces.size(); i++) {
+        for(int k = 0; k < 3; k++) {
+            shell[m_surface_faces[i][k]] += m_normals[i];
+        }
+    }
 
-        if(d > 0 || std::abs(d) > m_collision_epsilon) continue;
+    for(int i = 0; i < m_surface.size(); i++) {
+        shell[i] = vertex(m_surface[i]) - m_collision_epsilon*shell[i].normalized();
+    }
+}
 
-        Vector3d v0 = C-A;
-        Vector3d v1 = B-A;
-        Vector3d v2 = point - A;
+void Collider::beginSweep() {
+    // vertices that are not viewed from an object never move, so their shell is computed once
+    if(!m_view.base && !m_sweep_bvh.empty()) return;
 
-        double d00 = v0.dot(v0);
-        double d01 = v0.dot(v1);
-        double d11 = v1.dot(v1);
-        double d20 = v2.dot(v0);
-        double d21 = v2.dot(v1);
+    computeShell(m_shell_start);
+}
 
-        double denom = d00*d11-d01*d01;
+void Collider::updateSweep() {
+    if(!m_view.base && !m_sweep_bvh.empty()) return;
 
-        double u = (d11*d20-d01*d21)/denom;
-        double v = (d00*d21-d01*d20)/denom;
+    computeShell(m_shell_end);
 
-        if(u < 0 || v < 0 || u + v > 1) continue;
+    m_swept_boxes.resize(m_surface_faces.size());
+    for(int i = 0; i < m_surface_faces.size(); i++) {
+        AABB &box = m_swept_boxes[i];
+        box.reset();
+        for(int k = 0; k < 3; k++) {
+            box.extend(m_shell_start[m_surface_faces[i][k]]);
+            box.extend(m_shell_end[m_surface_faces[i][k]]);
+        }
+    }
 
-        Vector3d force = m_collision_penalty * std::abs(d)*normal;
-        return force;
+    if(m_sweep_bvh.empty()) {
+        m_sweep_bvh.build(m_swept_boxes);
+    } else {
+        m_sweep_bvh.refit(m_swept_boxes);
     }
+}
+
+double Collider::vertexImpact(const Vector3d &p0, const Vector3d &p1, Vector3d &normal) {
+    AABB box;
+    box.extend(p0);
+    box.extend(p1);
+
+    double impact = NO_IMPACT;
+    m_sweep_bvh.query(box, [&](int i) {
+        const Vector3i &f = m_surface_faces[i];
+        Vector3d n;
+        double t = vertexTriangleImpact(p0, p1,
+                                        m_shell_start[f[0]], m_shell_end[f[0]],
+                                        m_shell_start[f[1]], m_shell_end[f[1]],
+                                        m_shell_start[f[2]], m_shell_end[f[2]], n);
+        if(t < impact) {
+            impact = t;
+            normal = n;
+        }
+    });
+    return impact;
+}
 
-    return Vector3d(0,0,0);
+double Collider::edgeImpact(const Vector3d &p0, const Vector3d &p1, const Vector3d &q0, const Vector3d &q1, Vector3d &normal) {
+    AABB box;
+    box.extend(p0);
+    box.extend(p1);
+    box.extend(q0);
+    box.extend(q1);
+
+    // edges shared by two faces get tested twice, once against each face's normal, which is cheaper than keeping an
+    // edge list in sync
+    double impact = NO_IMPACT;
+    m_sweep_bvh.query(box, [&](int i) {
+        const Vector3i &f = m_surface_faces[i];
+        for(int k = 0; k < 3; k++) {
+            int r = f[k], s = f[(k+1)%3], o = f[(k+2)%3];
+            Vector3d n;
+            double t = edgeEdgeImpact(p0, p1, q0, q1,
+                                      m_shell_start[r], m_shell_end[r],
+                                      m_shell_start[s], m_shell_end[s],
+                                      m_shell_start[o], m_shell_end[o], n);
+            if(t < impact) {
+                impact = t;
+                normal = n;
+            }
+        }
+    });
+    return impact;
 }
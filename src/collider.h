@@ -3,30 +3,100 @@
 
 #include <vector>
 #include "Eigen/Dense"
+#include "aabb.h"
+#include "bvh.h"
 
+// non-owning, strided view of positions stored somewhere else (e.g. inside a FEMObject's nodes)
+struct VertexView {
+    const char *base = nullptr;
+    size_t stride = sizeof(Eigen::Vector3d);
+
+    const Eigen::Vector3d &operator[](int i) const {
+        return *reinterpret_cast<const Eigen::Vector3d *>(base + i*stride);
+    }
+};
+
+// whether point is at most epsilon behind triangle ABC with unit normal normal, and projects inside it.
+// d is the signed distance to the plane, u and v the barycentric weights of C and B
+bool inContactLayer(const Eigen::Vector3d &point, const Eigen::Vector3d &A, const Eigen::Vector3d &B, const Eigen::Vector3d &C,
+                    const Eigen::Vector3d &normal, double epsilon, double &d, double &u, double &v);
+
+// triangle mesh collider, and the base of the other collider types
 class Collider
 {
 public:
     Collider();
     Collider(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &faces, int id, bool is_flat, double collision_penalty, double collision_epsilon);
+    virtual ~Collider() {}
+
+    // whether point is behind a face by at most epsilon, and if so how deep. face is tested first if it is >= 0,
+    // and is set to the face hit or -1. clearance is set to a lower bound on how far point has to move, relative
+    // to the collider, before this collider can push on it
+    virtual bool detectContact(const Eigen::Vector3d &point, int &face, double &depth, double &clearance);
 
-    Eigen::Vector3d resolveCollision(Eigen::Vector3d point);
+    // velocity level contact: whether point is behind a face by at most reach, and if so how deep, that face's normal
+    // and the velocity of the collider's surface there. reach is the larger of epsilon and how far the point can have
+    // gone in since the last check, so points that went deep in one long step are still found. of several faces the
+    // point is behind, the one it is least deep behind is taken
+    virtual bool findContact(const Eigen::Vector3d &point, double reach, double &depth, Eigen::Vector3d &normal, Eigen::Vector3d &velocity);
 
-    void setVertices(const std::vector<Eigen::Vector3d> &vertices);
+    // read vertices (and their velocities) in place from the views instead of the copy made at construction
+    void bindVertices(VertexView view, VertexView velocities);
+    // recompute the bounding box and normals after the viewed vertices moved
+    virtual void update();
+
+    // box around everything this collider can push on, i.e. its vertices grown by the collision tolerance
+    AABB getBounds() {return m_bounds.expanded(m_collision_epsilon);}
+
+    // continuous collision runs against the inner shell, the surface pushed in by epsilon along the vertex normals,
+    // which a point only crosses once it has gone all the way through the penalty layer. beginSweep records the
+    // shell at the start of a step, updateSweep the shell at its end
+    virtual void beginSweep();
+    virtual void updateSweep();
+    virtual AABB getSweptBounds() {return m_sweep_bvh.getBounds();}
+    // first time in [0, 1] a point or an edge moving linearly over the step crosses the swept shell from outside, or
+    // NO_IMPACT. normal is set to the shell's outward normal where and when it was crossed
+    virtual double vertexImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, Eigen::Vector3d &normal);
+    virtual double edgeImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                              Eigen::Vector3d &normal);
+
+    // upper bound on how far any vertex has moved since construction, grows with every step
+    void addTravel(double distance) {m_travel += distance;}
+    double getTravel() {return m_travel;}
+
+    virtual Eigen::Vector3d getNormal(int face) {return m_normals[face];}
+    double getPenalty() {return m_collision_penalty;}
 
     int getId() {return m_id;}
+
+protected:
+    int m_id;
+    double m_collision_penalty;
+    double m_collision_epsilon;
+
+    AABB m_bounds;
+    double m_travel = 0;
+
 private:
+    const Eigen::Vector3d &vertex(int i) const {return m_view.base ? m_view[i] : m_vertices[i];}
+    bool testFace(int i, const Eigen::Vector3d &point, double reach, double &d, double &u, double &v);
+    void computeShell(std::vector<Eigen::Vector3d> &shell);
+
     std::vector<Eigen::Vector3d> m_vertices;
+    VertexView m_view;
+    VertexView m_velocities;
+    std::vector<int> m_surface;
     std::vector<Eigen::Vector3i> m_faces;
     std::vector<Eigen::Vector3d> m_normals;
+    std::vector<AABB> m_face_bounds;
 
-    int m_id;
     bool m_is_flat;
-    double m_collision_penalty;
-    double m_collision_epsilon;
 
-    double m_min_x, m_min_y, m_min_z;
-    double m_max_x, m_max_y, m_max_z;
+    std::vector<Eigen::Vector3i> m_surface_faces;  // m_faces indexing into m_surface
+    std::vector<Eigen::Vector3d> m_shell_start;
+    std::vector<Eigen::Vector3d> m_shell_end;
+    std::vector<AABB> m_swept_boxes;
+    BVH m_sweep_bvh;
 };
 
 #endif // COLLIDER_H
@@ -0,0 +1,93 @@
+#include "embedding.h"
+#include "bvh.h"
+#include "parallel.h"
+#include <cmath>
+#include <limits>
+
+using namespace Eigen;
+
+Embedding Embedding::bind(const std::vector<Vector3d> &nodes, const std::vector<Vector4i> &tets, const std::vector<Vector3d> &points) {
+    Embedding embedding;
+    if(tets.empty()) return embedding;
+    embedding.nodes.resize(points.size());
+    embedding.weights.resize(points.size());
+
+    // maps a point to the barycentric coordinates of its last three nodes. flat tets map nothing
+    std::vector<Matrix3d> inverses(tets.size());
+    std::vector<char> flat(tets.size(), 0);
+    std::vector<AABB> boxes(tets.size());
+    for(int t = 0; t < tets.size(); t++) {
+        const Vector4i &tet = tets[t];
+        Matrix3d edges;
+        for(int i = 0; i < 3; i++) {
+            edges.col(i) = nodes[tet[i+1]] - nodes[tet[0]];
+        }
+        double scale = edges.colwise().norm().prod();
+        flat[t] = !(std::abs(edges.determinant()) > 1e-12*scale);
+        if(!flat[t]) inverses[t] = edges.inverse();
+
+        for(int i = 0; i < 4; i++) {
+            boxes[t].extend(nodes[tet[i]]);
+        }
+    }
+
+    BVH bvh;
+    bvh.build(boxes);
+    const AABB &bounds = bvh.getBounds();
+    double diagonal = (bounds.max - bounds.min).norm();
+    double spacing = diagonal/std::cbrt(double(tets.size()));
+
+    parallelFor(points.size(), 1024, [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            const Vector3d &p = points[i];
+
+            // the tet whose smallest barycentric coordinate is largest contains p if that coordinate is not negative
+            int best = -1;
+            double best_score = std::numeric_limits<double>::lowest();
+            Vector4d best_weights;
+            auto visit = [&](int t) {
+                if(flat[t]) return;
+                Vector3d w = inverses[t]*(p - nodes[tets[t][0]]);
+                Vector4d weights(1 - w.sum(), w[0], w[1], w[2]);
+                double score = weights.minCoeff();
+                if(score > best_score) {
+                    best = t;
+                    best_score = score;
+                    best_weights = weights;
+                }
+            };
+
+            AABB box;
+            box.extend(p);
+            bvh.query(box, visit);
+
+            // outside the mesh, search ever wider around p until some tets turn up, and once more past that
+            for(double radius = spacing; best_score < 0 && radius < 4*diagonal; radius *= 2) {
+                bool found = best >= 0;
+                bvh.query(box.expanded(radius), visit);
+                if(found) break;
+            }
+
+            // only when every tet is flat
+            if(best < 0) {
+                best = 0;
+                best_weights = Vector4d(0.25, 0.25, 0.25, 0.25);
+            }
+            embedding.nodes[i] = tets[best];
+            embedding.weights[i] = best_weights;
+        }
+    });
+
+    return embedding;
+}
+
+void Embedding::apply(const std::vector<Vector3d> &nodes, std::vector<Vector3d> &points) const {
+    points.resize(this->nodes.size());
+    parallelFor(points.size(), 4096, [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            const Vector4i &n = this->nodes[i];
+            const Vector4d &w = weights[i];
+            points[i] = w[0]*nodes[n[0]] + w[1]*nodes[n[1]] + w[2]*nodes[n[2]] + w[3]*nodes[n[3]];
+        }
+    });
+}
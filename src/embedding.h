@@ -0,0 +1,24 @@
+#ifndef EMBEDDING_H
+#define EMBEDDING_H
+
+#include <vector>
+#include "Eigen/Dense"
+
+// a surface carried along by a tet mesh, such as a detailed render surface around a coarse simulation mesh. each of
+// its points is a fixed combination of the four nodes of the tet it was in at rest, so it moves with that tet
+struct Embedding {
+    // the nodes of point i's tet and its barycentric coordinates in it
+    std::vector<Eigen::Vector4i> nodes;
+    std::vector<Eigen::Vector4d> weights;
+
+    bool empty() const {return nodes.empty();}
+
+    // binds every point to the tet of nodes containing it. a point outside the mesh goes to the tet it is closest to
+    // being inside of, and follows it by extrapolation
+    static Embedding bind(const std::vector<Eigen::Vector3d> &nodes, const std::vector<Eigen::Vector4i> &tets, const std::vector<Eigen::Vector3d> &points);
+
+    // the points where the nodes have moved them
+    void apply(const std::vector<Eigen::Vector3d> &nodes, std::vector<Eigen::Vector3d> &points) const;
+};
+
+#endif // EMBEDDING_H
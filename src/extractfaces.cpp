@@ -1,32 +1,11 @@
 #include "extractfaces.h"
-#include <unordered_set>
+#include "parallel.h"
 #include <algorithm>
+#include <cstdint>
 
 using namespace Eigen;
 
-struct Vector3iEqual {
-    bool operator()(const Vector3i& v1, const Vector3i& v2) const {
-        Vector3i v1_sorted = v1;
-        Vector3i v2_sorted = v2;
-        std::sort(v1_sorted.data(), v1_sorted.data() + 3);
-        std::sort(v2_sorted.data(), v2_sorted.data() + 3);
-        return v1_sorted == v2_sorted;
-    }
-};
-
-struct Vector3iHash {
-    std::size_t operator()(const Vector3i& v) const {
-        Vector3i v_sorted = v;
-        std::sort(v_sorted.data(), v_sorted.data() + 3);
-        std::size_t seed = 0;
-        seed ^= std::hash<int>()(v_sorted.x()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        seed ^= std::hash<int>()(v_sorted.y()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        seed ^= std::hash<int>()(v_sorted.z()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-        return seed;
-    }
-};
-
-Vector3d computeNormal(Vector3i face, std::vector<Vector3d> &verts) {
+static Vector3d computeNormal(const Vector3i &face, const std::vector<Vector3d> &verts) {
     Vector3d v0 = verts[face[0]];
     Vector3d v1 = verts[face[1]];
     Vector3d v2 = verts[face[2]];
@@ -35,55 +14,153 @@ Vector3d computeNormal(Vector3i face, std::vector<Vector3d> &verts) {
     return e1.cross(e2);
 }
 
-bool isNormalOutward(const Vector3d& normal, int v_face, int v_opposite, std::vector<Vector3d> &verts) {
+static bool isNormalOutward(const Vector3d& normal, int v_face, int v_opposite, const std::vector<Vector3d> &verts) {
     Vector3d v = verts[v_opposite] - verts[v_face];
     return normal.dot(v) < 0;
 }
 
-std::vector<Vector3i> getTetrahedronFaces(Vector4i tet, std::vector<Vector3d> &verts) {
-    std::vector<Vector3i> faces = {
-        {tet[1], tet[2], tet[3]},
-        {tet[0], tet[2], tet[3]},
-        {tet[0], tet[1], tet[3]},
-        {tet[0], tet[1], tet[2]}
-    };
+// face k of the tet is the one opposite its vertex k, wound so its normal points out of the tet
+static Vector3i orientedFace(const Vector4i &tet, int k, const std::vector<Vector3d> &verts) {
+    static const int OTHERS[4][3] = {{1, 2, 3}, {0, 2, 3}, {0, 1, 3}, {0, 1, 2}};
+    Vector3i face(tet[OTHERS[k][0]], tet[OTHERS[k][1]], tet[OTHERS[k][2]]);
+
+    if (!isNormalOutward(computeNormal(face, verts), face[0], tet[k], verts)) {
+        std::reverse(face.data(), face.data() + 3);
+    }
+    return face;
+}
+
+// a face's vertex indices sorted, a in the high and b in the low half of ab, so equal faces of different tets get
+// equal keys. face is the index 4*tet + k of the face it came from
+struct FaceKey {
+    uint64_t ab;
+    uint32_t c;
+    uint32_t face;
+};
 
+// stable least significant digit first radix sort of keys by (ab, c), skipping the digits above bits that are zero
+// in every key. each pass counts digits per slice of keys in parallel and scatters the slices in order
+static void radixSort(std::vector<FaceKey> &keys, int bits) {
+    const int DIGIT_BITS = 11;
+    const int BUCKETS = 1 << DIGIT_BITS;
+    int n = keys.size();
+    int n_slices = std::max(1, std::min(threadCount(), n / 65536));
 
-    for (auto& face : faces) {
-        Vector3d normal = computeNormal(face, verts);
-        int v_opposite;
+    // (which word, shift) of every pass, c first
+    std::vector<std::pair<int, int>> passes;
+    for(int shift = 0; shift < bits; shift += DIGIT_BITS) passes.emplace_back(2, shift);
+    for(int shift = 0; shift < bits; shift += DIGIT_BITS) passes.emplace_back(1, shift);
+    for(int shift = 0; shift < bits; shift += DIGIT_BITS) passes.emplace_back(1, 32 + shift);
 
-        if (face[0] != tet[0] && face[1] != tet[0] && face[2] != tet[0]) v_opposite = tet[0];
-        else if (face[0] != tet[1] && face[1] != tet[1] && face[2] != tet[1]) v_opposite = tet[1];
-        else if (face[0] != tet[2] && face[1] != tet[2] && face[2] != tet[2]) v_opposite = tet[2];
-        else v_opposite = tet[3];
+    std::vector<FaceKey> scratch(n);
+    std::vector<int> counts(n_slices*BUCKETS);
+    for(const std::pair<int, int> &pass : passes) {
+        auto digit = [&](const FaceKey &key) {
+            uint64_t word = pass.first == 2 ? key.c : key.ab;
+            return int((word >> pass.second) & (BUCKETS - 1));
+        };
+        auto slice = [&](int s, int &begin, int &end) {
+            begin = int(int64_t(n)*s/n_slices);
+            end = int(int64_t(n)*(s+1)/n_slices);
+        };
 
-        if (!isNormalOutward(normal, face[0], v_opposite, verts)) {
-            std::reverse(face.begin(), face.end());
+        std::fill(counts.begin(), counts.end(), 0);
+        parallelFor(n_slices, 1, [&](int first, int last) {
+            for(int s = first; s < last; s++) {
+                int begin, end;
+                slice(s, begin, end);
+                int *count = counts.data() + s*BUCKETS;
+                for(int i = begin; i < end; i++) {
+                    count[digit(keys[i])]++;
+                }
+            }
+        });
+
+        // where each slice's keys with each digit start, digits major and slices minor so the sort stays stable
+        int offset = 0;
+        for(int d = 0; d < BUCKETS; d++) {
+            for(int s = 0; s < n_slices; s++) {
+                int count = counts[s*BUCKETS + d];
+                counts[s*BUCKETS + d] = offset;
+                offset += count;
+            }
         }
-    }
 
-    return faces;
+        parallelFor(n_slices, 1, [&](int first, int last) {
+            for(int s = first; s < last; s++) {
+                int begin, end;
+                slice(s, begin, end);
+                int *next = counts.data() + s*BUCKETS;
+                for(int i = begin; i < end; i++) {
+                    scratch[next[digit(keys[i])]++] = keys[i];
+                }
+            }
+        });
+        keys.swap(scratch);
+    }
 }
 
-// extracts outside faces of mesh into outsideFaces, the properly oriented faces of the tets are put in tetFullFaces
-void extractFaces(std::vector<Vector4i> &tets, std::vector<Vector3d> &verts, std::vector<Vector3i> &outsideFaces, std::vector<std::vector<Vector3i>> &tetFullFaces) {
-    std::unordered_set<Vector3i, Vector3iHash, Vector3iEqual> faceSet;
+// a face only one tet has is on the outside. faces are matched by sorting their keys, so equal ones end up next to
+// each other, and outside faces come out in the order of their tets
+void extractFaces(const std::vector<Vector4i> &tets, const std::vector<Vector3d> &verts, std::vector<Vector3i> &outsideFaces,
+                  std::vector<Vector3i> &tetFaces, std::vector<int> &faceNeighbors) {
+    int n_faces = 4*tets.size();
+    tetFaces.resize(n_faces);
+    std::vector<FaceKey> keys(n_faces);
 
-    for(Vector4i &tet : tets) {
-        std::vector<Vector3i> tetFaces = getTetrahedronFaces(tet, verts);
-        tetFullFaces.push_back(tetFaces);
+    parallelFor(tets.size(), 4096, [&](int begin, int end) {
+        for(int t = begin; t < end; t++) {
+            for(int k = 0; k < 4; k++) {
+                Vector3i face = orientedFace(tets[t], k, verts);
+                tetFaces[4*t + k] = face;
 
-        for(Vector3i &face : tetFaces) {
-            if(faceSet.contains(face)) {
-                faceSet.erase(face);
-            } else {
-                faceSet.insert(face);
+                std::sort(face.data(), face.data() + 3);
+                keys[4*t + k] = FaceKey{(uint64_t(uint32_t(face[0])) << 32) | uint32_t(face[1]), uint32_t(face[2]), uint32_t(4*t + k)};
             }
         }
+    });
+
+    int bits = 1;
+    while(bits < 32 && (size_t(1) << bits) < verts.size()) bits++;
+    radixSort(keys, bits);
+
+    // runs of equal keys are faces shared by tets. faces shared by more than two tets, which a proper mesh does not
+    // have, are paired up in order and an odd one out counts as outside
+    faceNeighbors.assign(n_faces, -1);
+    std::vector<char> outside(n_faces, 0);
+    for(int i = 0; i < n_faces; ) {
+        int j = i + 1;
+        while(j < n_faces && keys[j].ab == keys[i].ab && keys[j].c == keys[i].c) j++;
+
+        int k = i;
+        for(; k + 1 < j; k += 2) {
+            faceNeighbors[keys[k].face] = keys[k+1].face / 4;
+            faceNeighbors[keys[k+1].face] = keys[k].face / 4;
+        }
+        if(k < j) {
+            outside[keys[k].face] = 1;
+        }
+        i = j;
+    }
+
+    outsideFaces.clear();
+    for(int f = 0; f < n_faces; f++) {
+        if(outside[f]) {
+            outsideFaces.push_back(tetFaces[f]);
+        }
     }
+}
 
-    for(const Vector3i &face : faceSet) {
-        outsideFaces.push_back(face);
+// collects the sorted, unique vertex indices referenced by outsideFaces
+void extractSurfaceVertices(const std::vector<Vector3i> &outsideFaces, std::vector<int> &surfaceVertices) {
+    surfaceVertices.clear();
+    surfaceVertices.reserve(outsideFaces.size()*3);
+    for(const Vector3i &face : outsideFaces) {
+        surfaceVertices.push_back(face[0]);
+        surfaceVertices.push_back(face[1]);
+        surfaceVertices.push_back(face[2]);
     }
+
+    std::sort(surfaceVertices.begin(), surfaceVertices.end());
+    surfaceVertices.erase(std::unique(surfaceVertices.begin(), surfaceVertices.end()), surfaceVertices.end());
 }
@@ -3,6 +3,12 @@
 #include <vector>
 #include "Eigen/Dense"
 
-void extractFaces(std::vector<Eigen::Vector4i> &tets, std::vector<Eigen::Vector3d> &verts, std::vector<Eigen::Vector3i> &outsideFaces, std::vector<std::vector<Eigen::Vector3i>> &tetFullFaces);
+// finds the faces on the outside of the mesh. tetFaces gets the four faces of every tet, wound so their normals point
+// out of it, face k of tet t at 4*t + k and opposite the tet's vertex k. faceNeighbors[4*t + k] is the tet on the other
+// side of that face, or -1 if it is on the outside
+void extractFaces(const std::vector<Eigen::Vector4i> &tets, const std::vector<Eigen::Vector3d> &verts, std::vector<Eigen::Vector3i> &outsideFaces,
+                  std::vector<Eigen::Vector3i> &tetFaces, std::vector<int> &faceNeighbors);
+
+void extractSurfaceVertices(const std::vector<Eigen::Vector3i> &outsideFaces, std::vector<int> &surfaceVertices);
 
 #endif // EXTRACTFACES_H
@@ -1,109 +1,251 @@
 #include "femobject.h"
+#include "ccd.h"
 #include "iostream"
+#include <algorithm>
 
-double calculateTetrahedronVolume(const Eigen::Vector3d& v0, const Eigen::Vector3d& v1,
-                                  const Eigen::Vector3d& v2, const Eigen::Vector3d& v3) {
-    Eigen::Vector3d a = v1 - v0;
-    Eigen::Vector3d b = v2 - v0;
-    Eigen::Vector3d c = v3 - v0;
-
-    double volume = a.dot(b.cross(c));
-
-    return std::abs(volume) / 6.0;
-}
-
-Vector3d calculateAreaWeightedNormal(Face f, std::vector<Node> &nodes) {
-    Vector3d e1 = nodes[f.v1].position - nodes[f.v0].position;
-    Vector3d e2 = nodes[f.v2].position - nodes[f.v0].position;
-    return .5*e1.cross(e2);
-}
-
-Vector3d calculateAreaWeightedNormals(int node_idx, Tetrahedron tet, std::vector<Node> &nodes) {
-    Vector3d total = Vector3d(0,0,0);
-    for(Face &f : tet.faces) {
-        if(node_idx == f.v0 || node_idx == f.v1 || node_idx == f.v2) {
-            total += calculateAreaWeightedNormal(f, nodes);
-        }
-    }
-    return total;
-}
-
-FEMObject::FEMObject(std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets, std::vector<std::vector<Vector3i>> &tetFullFaces, Properties properties, Shape &shape, std::shared_ptr<Collider> collider) : FEMObject(vertices, tets, tetFullFaces, properties, shape) {
+FEMObject::FEMObject(std::shared_ptr<const MeshAsset> mesh, const Vector3d &offset, Properties properties, std::shared_ptr<Collider> collider) : FEMObject(mesh, offset, properties) {
     m_has_collider = true;
     m_own_collider = collider;
 }
 
-FEMObject::FEMObject(std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets, std::vector<std::vector<Vector3i>> &tetFullFaces, Properties properties, Shape &shape) :
-    m_shape(shape),
-    m_properties(properties)
+FEMObject::FEMObject(std::shared_ptr<const MeshAsset> mesh, const Vector3d &offset, Properties properties) :
+    m_properties(properties),
+    m_mesh(mesh)
 {
     m_has_collider = false;
+    m_contact_mode = ContactMode::Penalty;
     m_state_size = 0;
 
-    for(Vector3d &v : vertices) {
+    for(const Vector3d &v : m_mesh->rest_positions) {
         Node n;
-        n.position = v;
+        n.position = v + offset;
         n.velocity = m_properties.initial_velocity;
-        n.mass = 0;
         n.forceAccumulator = Vector3d(0,0,0);
         m_nodes.push_back(n);
         m_state_size += 6;
     }
 
-    int n_tets = tets.size();
-    for(int i = 0; i < n_tets; i++) {
-        Vector4i tet_verts = tets[i];
-        Tetrahedron t;
-        t.vertices.push_back(tet_verts[0]);
-        t.vertices.push_back(tet_verts[1]);
-        t.vertices.push_back(tet_verts[2]);
-        t.vertices.push_back(tet_verts[3]);
+    m_contact_cache.resize(m_mesh->surface_nodes.size(), ContactCache{Vector3d(0,0,0), 0, std::numeric_limits<double>::lowest(), nullptr, -1});
+    m_boundary_forces.resize(m_mesh->boundary_offsets.back());
+    for(int i : m_mesh->surface_nodes) {
+        m_projected_positions.push_back(m_nodes[i].position);
+    }
 
-        std::vector<Vector3i> tetFaces = tetFullFaces[i];
+    if(m_properties.self_collision) {
+        updateSelfCollision();
+    }
+    updateBounds();
+}
 
-        for(Vector3i &face : tetFaces) {
-            Face f;
-            f.v0 = face[0];
-            f.v1 = face[1];
-            f.v2 = face[2];
-            t.faces.push_back(f);
+void FEMObject::registerCollider(std::shared_ptr<Collider> collider) {
+    if(!m_has_collider || collider->getId() != m_own_collider->getId()) {
+        m_colliders.push_back(collider);
+    }
+}
+
+void FEMObject::bindCollider() {
+    if(m_has_collider) {
+        m_own_collider->bindVertices(VertexView{reinterpret_cast<const char *>(&m_nodes[0].position), sizeof(Node)},
+                                     VertexView{reinterpret_cast<const char *>(&m_nodes[0].velocity), sizeof(Node)});
+    }
+}
+
+void FEMObject::setActiveColliders(const std::vector<Collider *> &colliders) {
+    std::vector<Collider *> previous;
+    previous.swap(m_active_colliders);
+    for(Collider *c : colliders) {
+        if(!m_has_collider || c->getId() != m_own_collider->getId()) {
+            m_active_colliders.push_back(c);
         }
+    }
 
-        Vector3d v0, v1, v2, v3;
-        v0 = m_nodes[tet_verts[0]].position;
-        v1 = m_nodes[tet_verts[1]].position;
-        v2 = m_nodes[tet_verts[2]].position;
-        v3 = m_nodes[tet_verts[3]].position;
+    // cached clearances only account for the colliders that were active when they were computed
+    if(previous != m_active_colliders) {
+        for(ContactCache &cache : m_contact_cache) {
+            cache.clearance = std::numeric_limits<double>::lowest();
+        }
+    }
+}
 
-        // mass
-        double t_mass = m_properties.density * calculateTetrahedronVolume(v0, v1, v2, v3);
-        for(int i = 0; i < 4; i++) {
-            int np = t.vertices[i];
-            m_nodes[np].mass += t_mass/4;
+void FEMObject::updateBounds() {
+    m_bounds.reset();
+    for(int i : m_mesh->surface_nodes) {
+        m_bounds.extend(m_nodes[i].position);
+    }
+}
 
-            t.area_weighted_normals.push_back(calculateAreaWeightedNormals(np, t, m_nodes));
+void FEMObject::updateSelfCollision() {
+    m_surface_normals.resize(m_mesh->surface_faces.size());
+    m_surface_face_bounds.resize(m_mesh->surface_faces.size());
+    for(int i = 0; i < m_mesh->surface_faces.size(); i++) {
+        const Vector3d &A = m_nodes[m_mesh->surface_faces[i][0]].position;
+        const Vector3d &B = m_nodes[m_mesh->surface_faces[i][1]].position;
+        const Vector3d &C = m_nodes[m_mesh->surface_faces[i][2]].position;
+        m_surface_normals[i] = (B - A).cross(C - A).normalized();
+
+        m_surface_face_bounds[i].reset();
+        m_surface_face_bounds[i].extend(A);
+        m_surface_face_bounds[i].extend(B);
+        m_surface_face_bounds[i].extend(C);
+    }
+
+    if(m_surface_bvh.empty()) {
+        m_surface_bvh.build(m_surface_face_bounds);
+    } else {
+        m_surface_bvh.refit(m_surface_face_bounds);
+    }
+}
+
+// finds a face of the object's own surface that surface node k is at most epsilon behind. faces touching the node or
+// one of its neighbours are skipped, the node sits on or right next to those without the surface folding over
+bool FEMObject::findSelfContact(int k, int &face, double &depth, double &u, double &v) {
+    const Vector3d &p = m_nodes[m_mesh->surface_nodes[k]].position;
+    const int *ring = m_mesh->ring.data() + m_mesh->ring_offsets[k];
+    const int *ring_end = m_mesh->ring.data() + m_mesh->ring_offsets[k+1];
+
+    AABB box;
+    box.extend(p);
+    box = box.expanded(m_properties.collision_epsilon);
+
+    face = -1;
+    m_surface_bvh.query(box, [&](int i) {
+        if(face >= 0) return;
+
+        const Vector3i &f = m_mesh->surface_faces[i];
+        if(std::binary_search(ring, ring_end, f[0]) || std::binary_search(ring, ring_end, f[1]) || std::binary_search(ring, ring_end, f[2])) return;
+
+        double d, fu, fv;
+        if(!inContactLayer(p, m_nodes[f[0]].position, m_nodes[f[1]].position, m_nodes[f[2]].position, m_surface_normals[i], m_properties.collision_epsilon, d, fu, fv)) return;
+
+        face = i;
+        depth = -d;
+        u = fu;
+        v = fv;
+    });
+
+    return face >= 0;
+}
+
+void FEMObject::projectContacts() {
+    double travel = 0;
+    for(int k = 0; k < m_mesh->surface_nodes.size(); k++) {
+        Node &n = m_nodes[m_mesh->surface_nodes[k]];
+        // a node can have gone as deep as it moved since the last projection, which with long steps is well past
+        // epsilon. colliders that are objects themselves move too, and can add about as much again
+        double reach = 2*(n.position - m_projected_positions[k]).norm();
+        for(Collider *c : m_active_colliders) {
+            double depth;
+            Vector3d normal, velocity;
+            if(!c->findContact(n.position, reach, depth, normal, velocity)) continue;
+
+            // onto the face, and no longer moving into it relative to the collider
+            n.position += depth*normal;
+            travel = std::max(travel, depth);
+
+            double approach = (n.velocity - velocity).dot(normal);
+            if(approach < 0) {
+                n.velocity -= approach*normal;
+            }
         }
+    }
+
+    if(m_properties.self_collision) {
+        updateSelfCollision();
+
+        for(int k = 0; k < m_mesh->surface_nodes.size(); k++) {
+            int face;
+            double depth, u, v;
+            if(!findSelfContact(k, face, depth, u, v)) continue;
 
-        // beta
-        Matrix4d m;
-        m << v0.x(), v1.x(), v2.x(), v3.x(),
-             v0.y(), v1.y(), v2.y(), v3.y(),
-             v0.z(), v1.z(), v2.z(), v3.z(),
-             1,      1,      1,      1;
-        t.beta = m.inverse();
+            Node &n = m_nodes[m_mesh->surface_nodes[k]];
+            const Vector3i &f = m_mesh->surface_faces[face];
+            const Vector3d &normal = m_surface_normals[face];
+            Vector3d velocity = (1-u-v)*m_nodes[f[0]].velocity + v*m_nodes[f[1]].velocity + u*m_nodes[f[2]].velocity;
 
-        m_tets.push_back(t);
+            n.position += depth*normal;
+            travel = std::max(travel, depth);
+
+            double approach = (n.velocity - velocity).dot(normal);
+            if(approach < 0) {
+                n.velocity -= approach*normal;
+            }
+        }
     }
 
-    for(Node &n : m_nodes) {
-        n.mass_i = (n.mass*Matrix3d::Identity()).inverse();
+    for(int k = 0; k < m_mesh->surface_nodes.size(); k++) {
+        m_projected_positions[k] = m_nodes[m_mesh->surface_nodes[k]].position;
+    }
+    updateBounds();
+
+    if(m_has_collider) {
+        m_own_collider->addTravel(travel);
+        m_own_collider->update();
     }
 }
 
-void FEMObject::registerCollider(std::shared_ptr<Collider> collider) {
-    if(!m_has_collider || collider->getId() != m_own_collider->getId()) {
-        m_colliders.push_back(collider);
+double FEMObject::timeOfImpact(const VectorXd &start) {
+    AABB swept = m_bounds;
+    for(int i : m_mesh->surface_nodes) {
+        swept.extend(Vector3d(start.segment<3>(6*i)));
+    }
+
+    if(m_impact_times.size() != m_nodes.size()) {
+        m_impact_times.assign(m_nodes.size(), NO_IMPACT);
+        m_impact_normals.resize(m_nodes.size());
+    }
+    for(int i : m_mesh->surface_nodes) {
+        m_impact_times[i] = NO_IMPACT;
     }
+
+    auto record = [&](int i, double t, const Vector3d &normal) {
+        if(t < m_impact_times[i]) {
+            m_impact_times[i] = t;
+            m_impact_normals[i] = normal;
+        }
+    };
+
+    double impact = NO_IMPACT;
+    for(std::shared_ptr<Collider> &c : m_colliders) {
+        if(!swept.overlaps(c->getSweptBounds())) continue;
+
+        Vector3d normal;
+        for(int i : m_mesh->surface_nodes) {
+            double t = c->vertexImpact(start.segment<3>(6*i), m_nodes[i].position, normal);
+            if(t > 1) continue;
+            record(i, t, normal);
+            impact = std::min(impact, t);
+        }
+
+        for(const Vector2i &e : m_mesh->surface_edges) {
+            double t = c->edgeImpact(start.segment<3>(6*e[0]), m_nodes[e[0]].position,
+                                     start.segment<3>(6*e[1]), m_nodes[e[1]].position, normal);
+            if(t > 1) continue;
+            record(e[0], t, normal);
+            record(e[1], t, normal);
+            impact = std::min(impact, t);
+        }
+    }
+
+    return impact;
+}
+
+void FEMObject::clampToImpact(const VectorXd &start) {
+    // stop a little short so the node ends up inside the penalty layer rather than on its far side
+    VectorXd state = getState();
+    for(int i : m_mesh->surface_nodes) {
+        double t = m_impact_times[i];
+        if(t > 1) continue;
+
+        state.segment<3>(6*i) = start.segment<3>(6*i) + 0.9*t*(state.segment<3>(6*i) - start.segment<3>(6*i));
+
+        const Vector3d &normal = m_impact_normals[i];
+        Vector3d velocity = state.segment<3>(6*i+3);
+        double approach = velocity.dot(normal);
+        if(approach < 0) {
+            state.segment<3>(6*i+3) = velocity - approach*normal;
+        }
+    }
+    setState(state);
 }
 
 std::vector<Vector3d> FEMObject::getVertices() {
@@ -116,7 +258,20 @@ std::vector<Vector3d> FEMObject::getVertices() {
     return verts;
 }
 
+std::vector<double> FEMObject::getMasses() {
+    return m_mesh->masses;
+}
+
 void FEMObject::setState(VectorXd &state) {
+    if(m_has_collider) {
+        // how far the surface moved bounds how far the collider moved, for the other objects' contact caches
+        double travel = 0;
+        for(int i : m_mesh->surface_nodes) {
+            travel = std::max(travel, (state.segment<3>(6*i) - m_nodes[i].position).norm());
+        }
+        m_own_collider->addTravel(travel);
+    }
+
     int idx = 0;
     for(Node &n : m_nodes) {
         n.position = state.segment(idx, 3);
@@ -125,8 +280,10 @@ void FEMObject::setState(VectorXd &state) {
         idx+=3;
     }
 
+    updateBounds();
+
     if(m_has_collider) {
-        m_own_collider->setVertices(getVertices());
+        m_own_collider->update();
     }
 }
 
@@ -145,6 +302,108 @@ VectorXd FEMObject::getState() {
 }
 
 
+// surface nodes per chunk of contact detection
+static const int CONTACT_CHUNK = 256;
+
+void FEMObject::beginContacts() {
+    m_contact_travel = 0;
+    for(Collider *c : m_active_colliders) {
+        m_contact_travel += c->getTravel();
+    }
+
+    if(m_contact_mode == ContactMode::Penalty && m_properties.self_collision) {
+        updateSelfCollision();
+    }
+
+    m_contacts.resize(contactChunks());
+}
+
+int FEMObject::contactChunks() {
+    if(m_contact_mode != ContactMode::Penalty) return 0;
+
+    return (m_mesh->surface_nodes.size() + CONTACT_CHUNK - 1) / CONTACT_CHUNK;
+}
+
+// finds the contacts of surface nodes [chunk*CONTACT_CHUNK, (chunk+1)*CONTACT_CHUNK). only touches that chunk's
+// nodes' caches and contact list, so different chunks can run at the same time
+void FEMObject::detectContacts(int chunk) {
+    std::vector<Contact> &contacts = m_contacts[chunk];
+    contacts.clear();
+
+    int begin = chunk*CONTACT_CHUNK;
+    int end = std::min<int>(begin + CONTACT_CHUNK, m_mesh->surface_nodes.size());
+
+    for(int k = begin; k < end; k++) {
+        int i = m_mesh->surface_nodes[k];
+        const Vector3d &p = m_nodes[i].position;
+        ContactCache &cache = m_contact_cache[k];
+
+        // neither the node nor any collider can have moved far enough to touch since the last query
+        if((p - cache.anchor).norm() + (m_contact_travel - cache.travel) < cache.clearance) continue;
+
+        cache.anchor = p;
+        cache.travel = m_contact_travel;
+        cache.clearance = std::numeric_limits<double>::max();
+
+        Collider *hit = nullptr;
+        int hit_face = -1;
+        for(Collider *c : m_active_colliders) {
+            // the face touched last time is usually still the one being touched
+            int face = c == cache.collider ? cache.face : -1;
+            double depth, clearance;
+            bool touching = c->detectContact(p, face, depth, clearance);
+            cache.clearance = std::min(cache.clearance, clearance);
+            if(!touching) continue;
+
+            contacts.push_back(Contact{i, c, face, depth, c->getNormal(face), 0, 0});
+            hit = c;
+            hit_face = face;
+        }
+        cache.collider = hit;
+        cache.face = hit_face;
+    }
+
+    if(m_properties.self_collision) {
+        for(int k = begin; k < end; k++) {
+            int face;
+            double depth, u, v;
+            if(!findSelfContact(k, face, depth, u, v)) continue;
+
+            contacts.push_back(Contact{m_mesh->surface_nodes[k], nullptr, face, depth, m_surface_normals[face], u, v});
+        }
+    }
+}
+
+int FEMObject::contactCount() {
+    int count = 0;
+    for(const std::vector<Contact> &contacts : m_contacts) {
+        count += contacts.size();
+    }
+    return count;
+}
+
+// penalty forces from the contacts found by detectContacts. this stays a plain loop: there are only as many contacts
+// as surface nodes touching something, a few percent of the tets' work, and every one of them scatters into nodes
+// that can repeat, which no vector unit without scatter instructions does any faster
+void FEMObject::applyContacts() {
+    for(const std::vector<Contact> &contacts : m_contacts) {
+        for(const Contact &c : contacts) {
+            if(c.collider) {
+                m_nodes[c.node].forceAccumulator += c.collider->getPenalty()*c.depth*c.normal;
+                continue;
+            }
+
+            // the face gets pushed back just as hard, spread over its vertices
+            Vector3d force = m_properties.collision_penalty*c.depth*c.normal;
+            const Vector3i &f = m_mesh->surface_faces[c.face];
+            m_nodes[c.node].forceAccumulator += force;
+            m_nodes[f[0]].forceAccumulator -= (1-c.u-c.v)*force;
+            m_nodes[f[1]].forceAccumulator -= c.v*force;
+            m_nodes[f[2]].forceAccumulator -= c.u*force;
+        }
+    }
+}
+
 // to compute a derivative step
 
 // set accumulator for each node to 0
@@ -160,37 +419,41 @@ VectorXd FEMObject::getState() {
 VectorXd FEMObject::evalDerivative() {
     VectorXd derivative_vector(m_state_size);
 
+    beginDerivative();
+    for(int block = 0; block < forceBlocks(); block++) {
+        accumulateForces(block);
+    }
+    endDerivative(derivative_vector);
+
+    return derivative_vector;
+}
+
+void FEMObject::beginDerivative() {
     for(Node &n : m_nodes) {
         n.forceAccumulator = Vector3d(0,0,0);
+    }
+    std::fill(m_boundary_forces.begin(), m_boundary_forces.end(), Vector3d(0,0,0));
 
-        for(std::shared_ptr<Collider> &c : m_colliders) {
-            n.forceAccumulator += c->resolveCollision(n.position);
-        }
+    if(m_contact_mode == ContactMode::Penalty) {
+        applyContacts();
     }
+}
 
-    for(Tetrahedron &tet : m_tets) {
+// internal forces of the tets of one block. writes only to the nodes the block has to itself and to its own slots of
+// the shared ones, so different blocks can run at the same time
+void FEMObject::accumulateForces(int block) {
+    for(int t = m_mesh->block_offsets[block]; t < m_mesh->block_offsets[block+1]; t++) {
+        const Vector4i &tet = m_mesh->tets[t];
         Matrix<double, 3, 4> P;
         Matrix<double, 3, 4> V;
-        Vector3d p0, p1, p2, p3, v0, v1, v2, v3;
-        p0 = m_nodes[tet.vertices[0]].position;
-        p1 = m_nodes[tet.vertices[1]].position;
-        p2 = m_nodes[tet.vertices[2]].position;
-        p3 = m_nodes[tet.vertices[3]].position;
-        v0 = m_nodes[tet.vertices[0]].velocity;
-        v1 = m_nodes[tet.vertices[1]].velocity;
-        v2 = m_nodes[tet.vertices[2]].velocity;
-        v3 = m_nodes[tet.vertices[3]].velocity;
-
-        P << p0.x(), p1.x(), p2.x(), p3.x(),
-             p0.y(), p1.y(), p2.y(), p3.y(),
-             p0.z(), p1.z(), p2.z(), p3.z();
-
-        V << v0.x(), v1.x(), v2.x(), v3.x(),
-             v0.y(), v1.y(), v2.y(), v3.y(),
-             v0.z(), v1.z(), v2.z(), v3.z();
-
-        Matrix3d dxdu = (P*tet.beta).block<3,3>(0,0);
-        Matrix3d dxdotdu = (V*tet.beta).block<3,3>(0,0);
+        for(int i = 0; i < 4; i++) {
+            P.col(i) = m_nodes[tet[i]].position;
+            V.col(i) = m_nodes[tet[i]].velocity;
+        }
+
+        int shape = m_mesh->tet_shapes[t];
+        Matrix3d dxdu = P*m_mesh->betas[shape];
+        Matrix3d dxdotdu = V*m_mesh->betas[shape];
 
         Matrix3d strain = dxdu.transpose()*dxdu - Matrix3d::Identity();
         Matrix3d strain_rate = dxdu.transpose()*dxdotdu + dxdotdu.transpose()*dxdu;
@@ -199,21 +462,35 @@ VectorXd FEMObject::evalDerivative() {
         Matrix3d viscous_stress = m_properties.viscosity_1*Matrix3d::Identity()*strain_rate.trace() + 2*m_properties.viscosity_2*strain_rate;
         Matrix3d total_stress = elastic_stress+viscous_stress;
 
+        const Vector4i &slots = m_mesh->tet_slots[t];
         for(int i = 0; i < 4; i++) {
-            Vector3d f = (-1.0/3.0) * dxdu * total_stress * tet.area_weighted_normals[i];
-            m_nodes[tet.vertices[i]].forceAccumulator += f;
+            Vector3d f = (-1.0/3.0) * dxdu * total_stress * m_mesh->tet_normals[shape].col(i);
+            if(slots[i] >= 0) {
+                m_nodes[slots[i]].forceAccumulator += f;
+            } else {
+                m_boundary_forces[-1 - slots[i]] += f;
+            }
         }
 
     }
+}
+
+void FEMObject::endDerivative(Ref<VectorXd> derivative_vector) {
+    // the shared nodes' forces, summed in block order
+    for(int j = 0; j < m_mesh->boundary_nodes.size(); j++) {
+        Vector3d &force = m_nodes[m_mesh->boundary_nodes[j]].forceAccumulator;
+        for(int s = m_mesh->boundary_offsets[j]; s < m_mesh->boundary_offsets[j+1]; s++) {
+            force += m_boundary_forces[s];
+        }
+    }
 
     int idx = 0;
-    for(Node &n : m_nodes) {
+    for(int i = 0; i < m_nodes.size(); i++) {
+        const Node &n = m_nodes[i];
         derivative_vector.segment(idx, 3) = n.velocity;
         idx+=3;
 
-        derivative_vector.segment(idx, 3) = n.mass_i*n.forceAccumulator + Vector3d(0, -m_properties.gravity, 0);
+        derivative_vector.segment(idx, 3) = m_mesh->inverse_masses[i]*n.forceAccumulator + Vector3d(0, -m_properties.gravity, 0);
         idx+=3;
     }
-
-    return derivative_vector;
 }
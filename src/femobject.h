@@ -3,42 +3,104 @@
 
 #include <vector>
 #include "Eigen/Dense"
-#include "graphics/shape.h"
 #include "collider.h"
+#include "meshasset.h"
 #include <memory>
 
 using namespace Eigen;
 
 struct Node;
-struct Tetrahedron;
-struct Face;
+struct ContactCache;
+struct Contact;
 
 struct Properties {
-    double gravity, incompressibility, rigidity, viscosity_1, viscosity_2, density;
+    double gravity, incompressibility, rigidity, viscosity_1, viscosity_2;
     Vector3d initial_velocity;
+    double collision_penalty, collision_epsilon;
+    bool self_collision;
+};
+
+// how contact with colliders is resolved. Penalty pushes nodes out with stiff springs inside the derivative,
+// Projection moves nodes out and removes their approaching velocity after every step, which keeps contact
+// from limiting the timestep
+enum class ContactMode {
+    Penalty,
+    Projection
 };
 
 class FEMObject
 {
 public:
-    FEMObject(std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets, std::vector<std::vector<Vector3i>> &tetFullFaces, Properties properties, Shape &shape);
+    // the mesh's rest positions moved by offset are where the object starts
+    FEMObject(std::shared_ptr<const MeshAsset> mesh, const Vector3d &offset, Properties properties);
 
-    FEMObject(std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets, std::vector<std::vector<Vector3i>> &tetFullFaces, Properties properties, Shape &shape, std::shared_ptr<Collider> collider);
+    FEMObject(std::shared_ptr<const MeshAsset> mesh, const Vector3d &offset, Properties properties, std::shared_ptr<Collider> collider);
 
     std::vector<Vector3d> getVertices();
+    std::vector<double> getMasses();
     void setState(VectorXd &state);
     VectorXd getState();
     VectorXd evalDerivative();
-    Shape &getShape() {return m_shape;}
+    // evalDerivative in steps, for running it on several threads. beginDerivative does the serial setup, after which
+    // the blocks of tets can sum their forces in any order and on any thread, and endDerivative adds up the nodes the
+    // blocks share and writes the derivative
+    void beginDerivative();
+    int forceBlocks() {return m_mesh->block_offsets.size() - 1;}
+    void accumulateForces(int block);
+    void endDerivative(Ref<VectorXd> derivative);
     int getStateSize() {return m_state_size;}
     void registerCollider(std::shared_ptr<Collider> collider);
+    // points the own collider at this object's nodes, call once the object has reached its final address
+    void bindCollider();
+    // limits collision queries to the colliders the broadphase found near this object
+    void setActiveColliders(const std::vector<Collider *> &colliders);
+    // bounding box of the surface nodes
+    const AABB &getBounds() {return m_bounds;}
+    void setContactMode(ContactMode mode) {m_contact_mode = mode;}
+    // velocity level contact, for ContactMode::Projection
+    void projectContacts();
+    // contact detection, run before evalDerivative which applies the contacts found. beginContacts does the
+    // serial setup, after which the chunks can be detected in any order and on any thread
+    void beginContacts();
+    int contactChunks();
+    void detectContacts(int chunk);
+    int contactCount();
+    // first time in [0, 1] a surface node or edge tunnels into a collider while moving from start to the current state.
+    // also records for every surface node when it, or an edge of it, first tunneled and into which surface
+    double timeOfImpact(const VectorXd &start);
+    // pulls the nodes timeOfImpact found tunneling back along their path to just before their impact, and takes away
+    // their velocity into the surface they hit. every other node keeps its full step
+    void clampToImpact(const VectorXd &start);
 
 private:
+    void updateBounds();
+    void applyContacts();
+    void updateSelfCollision();
+    bool findSelfContact(int k, int &face, double &depth, double &u, double &v);
+
     Properties m_properties;
-    Shape m_shape;
+    ContactMode m_contact_mode;
+    std::shared_ptr<const MeshAsset> m_mesh;
     std::vector<Node> m_nodes;
-    std::vector<Tetrahedron> m_tets;
+
+    // self collision, against the mesh's surface faces in a BVH refit every evaluation
+    std::vector<Vector3d> m_surface_normals;
+    std::vector<AABB> m_surface_face_bounds;
+    BVH m_surface_bvh;
+    std::vector<ContactCache> m_contact_cache;
+    // what each block added to the nodes it shares with other blocks, per slot of the mesh
+    std::vector<Vector3d> m_boundary_forces;
+    // contacts found by each chunk of surface nodes in the last detection, and the active colliders' summed travel then
+    std::vector<std::vector<Contact>> m_contacts;
+    double m_contact_travel;
+    AABB m_bounds;
+    // where the surface nodes were after the last projectContacts, which bounds how deep they can be now
+    std::vector<Vector3d> m_projected_positions;
+    // per node, from the last timeOfImpact, only kept for surface nodes
+    std::vector<double> m_impact_times;
+    std::vector<Vector3d> m_impact_normals;
     std::vector<std::shared_ptr<Collider>> m_colliders;
+    std::vector<Collider *> m_active_colliders;
     std::shared_ptr<Collider> m_own_collider;
     bool m_has_collider;
 
@@ -47,22 +109,28 @@ private:
 };
 
 struct Node {
-    double mass;
-    Matrix3d mass_i;
     Vector3d forceAccumulator;
     Vector3d position;
     Vector3d velocity;
 };
 
-struct Face {
-    int v0, v1, v2;
+// what the last full collision query found for a surface node
+struct ContactCache {
+    Vector3d anchor;     // where the node was
+    double travel;       // summed travel of the active colliders at that time
+    double clearance;    // how far the node and colliders can move before anything can touch it
+    Collider *collider;  // collider it was touching, if any
+    int face;            // face of that collider it was touching
 };
 
-struct Tetrahedron {
-    Matrix4d beta;
-    std::vector<Face> faces;
-    std::vector<int> vertices;
-    std::vector<Vector3d> area_weighted_normals;
+// a surface node at most epsilon behind a face of a collider, or of the object's own surface if collider is null
+struct Contact {
+    int node;
+    Collider *collider;
+    int face;
+    double depth;
+    Vector3d normal;
+    double u, v;         // barycentric weights of the face's third and second vertex, for self contact
 };
 
 
@@ -0,0 +1,16 @@
+#ifndef FEMOBSERVER_H
+#define FEMOBSERVER_H
+
+#include <vector>
+#include "Eigen/Dense"
+
+// how a renderer (or anything else) follows the simulation without the core knowing about it.
+// FEMSystem::notifyObservers hands every registered observer the current node positions of each object
+class FEMObserver
+{
+public:
+    virtual ~FEMObserver() {}
+    virtual void objectUpdated(int object, const std::vector<Eigen::Vector3d> &vertices) = 0;
+};
+
+#endif // FEMOBSERVER_H
@@ -1,4 +1,8 @@
 #include "femsystem.h"
+#include "ccd.h"
+#include "parallel.h"
+#include <algorithm>
+#include <chrono>
 
 FEMSystem::FEMSystem() {
     m_state_size = 0;
@@ -23,18 +27,126 @@ void FEMSystem::setState(VectorXd &newState) {
         o.setState(v);
         idx += o.getStateSize();
     }
+
+    updateBroadphase();
 }
 
+// two stages: contact detection over chunks of every object's surface nodes, then force assembly over blocks of every
+// object's tets. each step writes only to its own chunk, block or object, so all of them run on the thread pool
 VectorXd FEMSystem::evalDerivative() {
     Eigen::VectorXd combinedDerivative(m_state_size);
+    auto start = std::chrono::steady_clock::now();
 
+    m_contact_work.clear();
+    for(int i = 0; i < m_objects.size(); i++) {
+        m_objects[i].beginContacts();
+        for(int j = 0; j < m_objects[i].contactChunks(); j++) {
+            m_contact_work.push_back(Vector2i(i, j));
+        }
+    }
+
+    parallelFor(m_contact_work.size(), 1, [&](int begin, int end) {
+        for(int w = begin; w < end; w++) {
+            m_objects[m_contact_work[w][0]].detectContacts(m_contact_work[w][1]);
+        }
+    });
+
+    auto detected = std::chrono::steady_clock::now();
+
+    std::vector<int> offsets(m_objects.size());
     int idx = 0;
+    for(int i = 0; i < m_objects.size(); i++) {
+        offsets[i] = idx;
+        idx += m_objects[i].getStateSize();
+        m_stats.contacts += m_objects[i].contactCount();
+    }
+
+    parallelFor(m_objects.size(), 1, [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            m_objects[i].beginDerivative();
+        }
+    });
+
+    m_force_work.clear();
+    for(int i = 0; i < m_objects.size(); i++) {
+        for(int j = 0; j < m_objects[i].forceBlocks(); j++) {
+            m_force_work.push_back(Vector2i(i, j));
+        }
+    }
+
+    parallelFor(m_force_work.size(), 1, [&](int begin, int end) {
+        for(int w = begin; w < end; w++) {
+            m_objects[m_force_work[w][0]].accumulateForces(m_force_work[w][1]);
+        }
+    });
+
+    parallelFor(m_objects.size(), 1, [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            m_objects[i].endDerivative(combinedDerivative.segment(offsets[i], m_objects[i].getStateSize()));
+        }
+    });
+
+    auto assembled = std::chrono::steady_clock::now();
+    m_stats.evaluations++;
+    m_stats.detect_seconds += std::chrono::duration<double>(detected - start).count();
+    m_stats.assembly_seconds += std::chrono::duration<double>(assembled - detected).count();
+
+    return combinedDerivative;
+}
+
+void FEMSystem::setContactMode(ContactMode mode) {
+    m_contact_mode = mode;
+    for(FEMObject &o : m_objects) {
+        o.setContactMode(mode);
+    }
+}
+
+void FEMSystem::projectContacts() {
+    if(m_contact_mode != ContactMode::Projection) return;
+
     for(FEMObject &o : m_objects) {
-        combinedDerivative.segment(idx, o.getStateSize()) = o.evalDerivative();
+        o.projectContacts();
+    }
+
+    updateBroadphase();
+}
+
+void FEMSystem::beginSweep() {
+    for(std::shared_ptr<Collider> &c : m_colliders) {
+        c->beginSweep();
+    }
+}
+
+double FEMSystem::timeOfImpact(VectorXd &startState) {
+    for(std::shared_ptr<Collider> &c : m_colliders) {
+        c->updateSweep();
+    }
+
+    m_impacts.resize(m_objects.size());
+    double impact = NO_IMPACT;
+    int idx = 0;
+    for(int i = 0; i < m_objects.size(); i++) {
+        FEMObject &o = m_objects[i];
+        m_impacts[i] = o.timeOfImpact(startState.segment(idx, o.getStateSize()));
+        impact = std::min(impact, m_impacts[i]);
         idx += o.getStateSize();
     }
 
-    return combinedDerivative;
+    return impact;
+}
+
+// only the objects that tunneled are held back, everything else keeps its full step
+void FEMSystem::clampToImpact(VectorXd &startState) {
+    int idx = 0;
+    for(int i = 0; i < m_objects.size(); i++) {
+        FEMObject &o = m_objects[i];
+        if(m_impacts[i] <= 1) {
+            o.clampToImpact(startState.segment(idx, o.getStateSize()));
+        }
+        idx += o.getStateSize();
+    }
+
+    updateBroadphase();
 }
 
 void FEMSystem::addObject(FEMObject &object) {
@@ -42,37 +154,90 @@ void FEMSystem::addObject(FEMObject &object) {
     m_state_size += object.getStateSize();
 }
 
-void FEMSystem::addShape(Shape &shape) {
-    m_shapes.push_back(shape);
-}
-
 void FEMSystem::addCollider(std::shared_ptr<Collider> collider) {
     m_colliders.push_back(collider);
 }
 
+void FEMSystem::addObserver(FEMObserver *observer) {
+    m_observers.push_back(observer);
+}
+
+void FEMSystem::notifyObservers() {
+    if(m_observers.empty()) return;
+
+    for(int i = 0; i < m_objects.size(); i++) {
+        std::vector<Vector3d> vertices = m_objects[i].getVertices();
+        for(FEMObserver *observer : m_observers) {
+            observer->objectUpdated(i, vertices);
+        }
+    }
+}
+
 void FEMSystem::init() {
+    // objects are stored by value, so colliders can only view their nodes once m_objects stops growing
+    for(FEMObject &o : m_objects) {
+        o.bindCollider();
+    }
+
     for(std::shared_ptr<Collider> &c : m_colliders) {
         for(FEMObject &o : m_objects) {
             o.registerCollider(c);
         }
     }
+
+    updateBroadphase();
 }
 
-void FEMSystem::updateVertices() {
-    for(FEMObject &o : m_objects) {
-        Shape s = o.getShape();
-        s.setVertices(o.getVertices());
+// sweep and prune along x over every object and collider box, so an object only runs
+// per node checks against colliders it could actually touch
+void FEMSystem::updateBroadphase() {
+    m_sweep.clear();
+    for(int i = 0; i < m_objects.size(); i++) {
+        m_sweep.push_back({m_objects[i].getBounds(), i, true});
+    }
+    for(int i = 0; i < m_colliders.size(); i++) {
+        m_sweep.push_back({m_colliders[i]->getBounds(), i, false});
     }
-}
 
-void FEMSystem::toggleWire() {
-    for(Shape &s : m_shapes) {
-        s.toggleWireframe();
+    std::sort(m_sweep.begin(), m_sweep.end(), [](const SweepEntry &a, const SweepEntry &b) {
+        return a.box.min.x() < b.box.min.x();
+    });
+
+    m_active.resize(m_objects.size());
+    for(std::vector<int> &active : m_active) {
+        active.clear();
+    }
+
+    std::vector<int> open_objects;
+    std::vector<int> open_colliders;
+    for(int i = 0; i < m_sweep.size(); i++) {
+        const SweepEntry &e = m_sweep[i];
+        auto closed = [&](int j) {return m_sweep[j].box.max.x() < e.box.min.x();};
+        std::erase_if(open_objects, closed);
+        std::erase_if(open_colliders, closed);
+
+        if(e.is_object) {
+            for(int j : open_colliders) {
+                if(e.box.overlaps(m_sweep[j].box)) m_active[e.index].push_back(m_sweep[j].index);
+            }
+            open_objects.push_back(i);
+        } else {
+            for(int j : open_objects) {
+                if(e.box.overlaps(m_sweep[j].box)) m_active[m_sweep[j].index].push_back(e.index);
+            }
+            open_colliders.push_back(i);
+        }
     }
-}
 
-void FEMSystem::draw(Shader *shader) {
-    for(Shape &s : m_shapes) {
-        s.draw(shader);
+    std::vector<Collider *> colliders;
+    for(int i = 0; i < m_objects.size(); i++) {
+        // keep registration order so forces are summed the same way every step
+        std::sort(m_active[i].begin(), m_active[i].end());
+
+        colliders.clear();
+        for(int c : m_active[i]) {
+            colliders.push_back(m_colliders[c].get());
+        }
+        m_objects[i].setActiveColliders(colliders);
     }
 }
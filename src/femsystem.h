@@ -2,7 +2,7 @@
 #define FEMSYSTEM_H
 #include "Eigen/Dense"
 #include "femobject.h"
-#include "graphics/shape.h"
+#include "femobserver.h"
 
 using namespace Eigen;
 
@@ -15,19 +15,50 @@ public:
     VectorXd evalDerivative();
     void setState(VectorXd &newState);
     void addObject(FEMObject &object);
-    void addShape(Shape &shape);
     void addCollider(std::shared_ptr<Collider> collider);
     void init();
-    void updateVertices();
-    void draw(Shader *shader);
-    void toggleWire();
+    void updateBroadphase();
+    void setContactMode(ContactMode mode);
+    // call after every step, does nothing unless the contact mode is ContactMode::Projection
+    void projectContacts();
+    // continuous collision: call beginSweep before a step, then timeOfImpact with the state from before it
+    void beginSweep();
+    double timeOfImpact(VectorXd &startState);
+    void clampToImpact(VectorXd &startState);
+    int getObjectCount() {return m_objects.size();}
+    FEMObject &getObject(int i) {return m_objects[i];}
+    // observers are not owned, and are told about every object each time notifyObservers is called
+    void addObserver(FEMObserver *observer);
+    void notifyObservers();
+
+    // where evalDerivative spends its time, summed since the last reset
+    struct Stats {
+        long evaluations = 0;
+        long contacts = 0;
+        double detect_seconds = 0;
+        double assembly_seconds = 0;
+    };
+    const Stats &getStats() {return m_stats;}
+    void resetStats() {m_stats = Stats();}
 
 private:
+    struct SweepEntry {
+        AABB box;
+        int index;
+        bool is_object;
+    };
 
     std::vector<FEMObject> m_objects;
-    std::vector<Shape> m_shapes;
     std::vector<std::shared_ptr<Collider>> m_colliders;
+    std::vector<FEMObserver *> m_observers;
+    std::vector<SweepEntry> m_sweep;
+    std::vector<std::vector<int>> m_active;
+    std::vector<double> m_impacts;
+    std::vector<Vector2i> m_contact_work;  // (object, chunk) pairs for contact detection
+    std::vector<Vector2i> m_force_work;    // (object, block) pairs for force assembly
+    Stats m_stats;
     int m_state_size;
+    ContactMode m_contact_mode = ContactMode::Penalty;
 };
 
 
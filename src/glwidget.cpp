@@ -166,10 +166,10 @@ void GLWidget::keyReleaseEvent(QKeyEvent *event)
 
 // ================== Physics Tick
 
+// the simulation steps on its own thread, this only moves the camera and asks for a repaint
 void GLWidget::tick()
 {
     float deltaSeconds = m_deltaTimeProvider.restart() / 1000.f;
-    m_sim.update(deltaSeconds);
 
     // Move camera
     auto look = m_camera.getLook();
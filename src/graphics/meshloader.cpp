@@ -3,47 +3,474 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "util/tiny_obj_loader.h"
 
-#include <iostream>
+#include "lattice.h"
+#include "mappedfile.h"
+#include "parallel.h"
 
-#include <QString>
-#include <QFile>
-#include <QTextStream>
-#include <QRegularExpression>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string_view>
 
 using namespace Eigen;
 
-bool MeshLoader::loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets)
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// reads the whitespace separated number at p into value and moves p past it, false if there is none. like a stream,
+// takes a leading + and stops at the first character that cannot be part of the number
+template<typename T>
+static bool parseNumber(const char *&p, const char *end, T &value) {
+    while(p < end && isSpace(*p)) p++;
+    if(p < end && *p == '+') p++;
+
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if(result.ec != std::errc()) return false;
+    p = result.ptr;
+    return true;
+}
+
+// "v x y z" lines are vertices and "t a b c d" lines tets, anything else is skipped. begin and end are on line starts
+static void parseLines(const char *begin, const char *end, std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets) {
+    const char *p = begin;
+    while(p < end) {
+        const char *line_end = static_cast<const char *>(memchr(p, '\n', end - p));
+        if(!line_end) line_end = end;
+
+        while(p < line_end && isSpace(*p)) p++;
+        if(p + 1 < line_end && isSpace(p[1]) && (*p == 'v' || *p == 't')) {
+            char tag = *p;
+            p++;
+            if(tag == 'v') {
+                Vector3d v;
+                if(parseNumber(p, line_end, v[0]) && parseNumber(p, line_end, v[1]) && parseNumber(p, line_end, v[2])) {
+                    vertices.push_back(v);
+                }
+            } else {
+                Vector4i t;
+                if(parseNumber(p, line_end, t[0]) && parseNumber(p, line_end, t[1]) && parseNumber(p, line_end, t[2]) && parseNumber(p, line_end, t[3])) {
+                    tets.push_back(t);
+                }
+            }
+        }
+
+        p = line_end + 1;
+    }
+}
+
+// files smaller than this are parsed on one thread, it is not worth waking the others
+static const size_t PARALLEL_PARSE_BYTES = 4 << 20;
+
+static bool hasExtension(const std::string &filepath, const std::string &extension) {
+    return filepath.size() >= extension.size() && filepath.compare(filepath.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool MeshLoader::loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                             int lattice_resolution)
+{
+    if(hasExtension(filepath, ".obj")) {
+        std::vector<Vector3d> surface_vertices;
+        std::vector<Vector3i> surface_faces;
+        if(!loadTriMesh(filepath, surface_vertices, surface_faces)) return false;
+        if(!tetrahedralizeLattice(surface_vertices, surface_faces, lattice_resolution, vertices, tets)) {
+            std::cout << "Error: no lattice cube is inside the surface of " << filepath << std::endl;
+            return false;
+        }
+        return true;
+    }
+    if(hasExtension(filepath, ".node") || hasExtension(filepath, ".ele")) {
+        return loadTetGen(filepath.substr(0, filepath.rfind('.')), vertices, tets);
+    }
+    if(hasExtension(filepath, ".msh")) {
+        return loadGmsh(filepath, vertices, tets);
+    }
+    return loadTextMesh(filepath, vertices, tets);
+}
+
+std::vector<std::string> MeshLoader::sourceFiles(const std::string &filepath)
+{
+    if(hasExtension(filepath, ".node") || hasExtension(filepath, ".ele")) {
+        std::string base = filepath.substr(0, filepath.rfind('.'));
+        return {base + ".node", base + ".ele"};
+    }
+    return {filepath};
+}
+
+bool MeshLoader::loadTriMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector3i> &faces)
+{
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filepath.c_str())) {
+        std::cout << "Error loading obj " << filepath << ": " << err << std::endl;
+        return false;
+    }
+
+    vertices.clear();
+    vertices.reserve(attrib.vertices.size()/3);
+    for(size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+        vertices.emplace_back(attrib.vertices[i], attrib.vertices[i+1], attrib.vertices[i+2]);
+    }
+
+    faces.clear();
+    for(const tinyobj::shape_t &shape : shapes) {
+        size_t first = 0;
+        for(unsigned char n : shape.mesh.num_face_vertices) {
+            for(int k = 2; k < n; k++) {
+                faces.emplace_back(shape.mesh.indices[first].vertex_index,
+                                   shape.mesh.indices[first + k - 1].vertex_index,
+                                   shape.mesh.indices[first + k].vertex_index);
+            }
+            first += n;
+        }
+    }
+    return true;
+}
+
+bool MeshLoader::loadTextMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets)
 {
-    QString qpath = QString::fromStdString(filepath);
-    QFile file(qpath);
+    MappedFile file(filepath);
 
-    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if(!file.isOpen()) {
         std::cout << "Error opening file: " << filepath << std::endl;
         return false;
     }
-    QTextStream in(&file);
 
-    QRegularExpression vrxp("v (-?\\d*\\.?\\d+) +(-?\\d*\\.?\\d+) +(-?\\d*\\.?\\d+)");
-    QRegularExpression trxp("t (\\d+) +(\\d+) +(\\d+) +(\\d+)");
+    const char *data = file.data();
+    const char *end = data + file.size();
+
+    // split into about equal chunks ending on line ends, parse each on its own and join them in file order
+    int n_chunks = file.size() < PARALLEL_PARSE_BYTES ? 1 : threadCount();
+    std::vector<const char *> bounds(n_chunks + 1, end);
+    bounds[0] = data;
+    for(int c = 1; c < n_chunks; c++) {
+        const char *p = std::max(bounds[c-1], data + file.size()/n_chunks*c);
+        const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+        bounds[c] = newline ? newline + 1 : end;
+    }
+
+    std::vector<std::vector<Vector3d>> chunk_vertices(n_chunks);
+    std::vector<std::vector<Vector4i>> chunk_tets(n_chunks);
+    parallelFor(n_chunks, 1, [&](int first, int last) {
+        for(int c = first; c < last; c++) {
+            parseLines(bounds[c], bounds[c+1], chunk_vertices[c], chunk_tets[c]);
+        }
+    });
+
+    for(int c = 0; c < n_chunks; c++) {
+        vertices.insert(vertices.end(), chunk_vertices[c].begin(), chunk_vertices[c].end());
+        tets.insert(tets.end(), chunk_tets[c].begin(), chunk_tets[c].end());
+    }
+    return true;
+}
+
+// skips whitespace, line ends and # comments up to the next token
+static void skipBlank(const char *&p, const char *end) {
+    while(p < end) {
+        if(isSpace(*p) || *p == '\n') {
+            p++;
+        } else if(*p == '#') {
+            const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            p = newline ? newline : end;
+        } else {
+            return;
+        }
+    }
+}
+
+template<typename T>
+static bool readToken(const char *&p, const char *end, T &value) {
+    skipBlank(p, end);
+    return parseNumber(p, end, value);
+}
 
-    while(!in.atEnd()) {
-        QString line = in.readLine();
-        auto match = vrxp.match(line);
-        if(match.hasMatch()) {
-            vertices.emplace_back(match.captured(1).toDouble(),
-                                  match.captured(2).toDouble(),
-                                  match.captured(3).toDouble());
+// TetGen's basepath.node holds "count 3 attributes markers" and then "index x y z" plus that many attributes and
+// markers per point, and basepath.ele "count nodes_per_tet region" and then "index a b c d" plus any further nodes
+// and the region per tet. points are numbered from 0 or 1, whichever the first one uses
+bool MeshLoader::loadTetGen(const std::string &basepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets)
+{
+    MappedFile node_file(basepath + ".node");
+    MappedFile ele_file(basepath + ".ele");
+    if(!node_file.isOpen() || !ele_file.isOpen()) {
+        std::cout << "Error opening file: " << basepath << (node_file.isOpen() ? ".ele" : ".node") << std::endl;
+        return false;
+    }
+
+    const char *p = node_file.data();
+    const char *end = p + node_file.size();
+    long n_points;
+    int dimension, n_attributes, n_markers;
+    if(!readToken(p, end, n_points) || !readToken(p, end, dimension) || !readToken(p, end, n_attributes) || !readToken(p, end, n_markers) ||
+       n_points < 0 || dimension != 3 || n_attributes < 0 || n_markers < 0) {
+        std::cout << "Error: bad TetGen header in " << basepath << ".node" << std::endl;
+        return false;
+    }
+
+    long first_index = 0;
+    size_t first_vertex = vertices.size();
+    vertices.reserve(first_vertex + n_points);
+    for(long i = 0; i < n_points; i++) {
+        long index;
+        Vector3d v;
+        if(!readToken(p, end, index) || !readToken(p, end, v[0]) || !readToken(p, end, v[1]) || !readToken(p, end, v[2])) {
+            std::cout << "Error: " << basepath << ".node ends before all " << n_points << " points" << std::endl;
+            return false;
+        }
+        for(int k = 0; k < n_attributes + n_markers; k++) {
+            double skipped;
+            if(!readToken(p, end, skipped)) break;
+        }
+        if(i == 0) first_index = index;
+        vertices.push_back(v);
+    }
+
+    p = ele_file.data();
+    end = p + ele_file.size();
+    long n_tets;
+    int nodes_per_tet, n_regions;
+    if(!readToken(p, end, n_tets) || !readToken(p, end, nodes_per_tet) || !readToken(p, end, n_regions) ||
+       n_tets < 0 || (nodes_per_tet != 4 && nodes_per_tet != 10) || n_regions < 0) {
+        std::cout << "Error: bad TetGen header in " << basepath << ".ele" << std::endl;
+        return false;
+    }
+
+    // second order tets list their corners first, which are all the simulation uses
+    tets.reserve(tets.size() + n_tets);
+    for(long i = 0; i < n_tets; i++) {
+        long index;
+        long nodes[10];
+        bool complete = readToken(p, end, index);
+        for(int k = 0; k < nodes_per_tet && complete; k++) {
+            complete = readToken(p, end, nodes[k]);
+        }
+        for(int k = 0; k < n_regions && complete; k++) {
+            double region;
+            complete = readToken(p, end, region);
+        }
+        if(!complete) {
+            std::cout << "Error: " << basepath << ".ele ends before all " << n_tets << " tets" << std::endl;
+            return false;
+        }
+
+        Vector4i t;
+        for(int k = 0; k < 4; k++) {
+            long node = nodes[k] - first_index;
+            if(node < 0 || node >= n_points) {
+                std::cout << "Error: tet " << index << " in " << basepath << ".ele uses missing point " << nodes[k] << std::endl;
+                return false;
+            }
+            t[k] = int(first_vertex + node);
+        }
+        tets.push_back(t);
+    }
+    return true;
+}
+
+// values of a Gmsh section, either text numbers or binary in the file's own sizes. after a failed read every
+// further read fails too
+struct GmshReader {
+    const char *p;
+    const char *end;
+    bool binary;
+    int size_bytes;
+    bool ok = true;
+
+    template<typename T>
+    T raw(int bytes) {
+        T value = 0;
+        if(!ok || end - p < bytes) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, p, bytes);
+        p += bytes;
+        return value;
+    }
+
+    template<typename T>
+    T text() {
+        T value = 0;
+        ok = ok && readToken(p, end, value);
+        return value;
+    }
+
+    uint64_t size() {return binary ? (size_bytes == 8 ? raw<uint64_t>(8) : raw<uint32_t>(4)) : text<uint64_t>();}
+    int integer() {return binary ? raw<int32_t>(4) : text<int>();}
+    double real() {return binary ? raw<double>(8) : text<double>();}
+};
+
+// nodes of each Gmsh element type up to 31, 0 for unused numbers
+static const int GMSH_ELEMENT_NODES[] = {0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13, 9, 10, 12, 15, 15, 21, 4, 5, 6, 20, 35, 56};
+
+static bool isGmshTet(int type) {
+    return type == 4 || type == 11 || type == 29 || type == 30 || type == 31;
+}
+
+// Gmsh MSH 4.1. reads the nodes of every entity and the elements that are tets of any order, taking their corners.
+// everything else, including lower dimensional elements, is skipped
+bool MeshLoader::loadGmsh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets)
+{
+    MappedFile file(filepath);
+    if(!file.isOpen()) {
+        std::cout << "Error opening file: " << filepath << std::endl;
+        return false;
+    }
+
+    GmshReader in{file.data(), file.data() + file.size(), false, 8};
+    std::string_view contents(file.data(), file.size());
+
+    // node tags can have gaps, so they are mapped to vertex indices
+    std::vector<int> tag_vertices;
+    bool has_format = false;
+
+    while(true) {
+        skipBlank(in.p, in.end);
+        if(in.p >= in.end) break;
+
+        const char *line_end = static_cast<const char *>(memchr(in.p, '\n', in.end - in.p));
+        if(!line_end) line_end = in.end;
+        std::string_view section(in.p, line_end - in.p);
+        while(!section.empty() && isSpace(section.back())) section.remove_suffix(1);
+        if(section.empty() || section[0] != '$') {
+            std::cout << "Error: expected a section in " << filepath << std::endl;
+            return false;
+        }
+        in.p = line_end < in.end ? line_end + 1 : in.end;
+        std::string name(section.substr(1));
+
+        if(name == "MeshFormat") {
+            double version = in.text<double>();
+            int file_type = in.text<int>();
+            in.size_bytes = in.text<int>();
+            if(!in.ok || version < 4.1 || version >= 5 || (in.size_bytes != 4 && in.size_bytes != 8)) {
+                std::cout << "Error: " << filepath << " is not a MSH 4.1 file" << std::endl;
+                return false;
+            }
+            if(file_type == 1) {
+                // a binary 1 follows the header line, telling whether the file has this machine's byte order
+                const char *newline = static_cast<const char *>(memchr(in.p, '\n', in.end - in.p));
+                in.p = newline ? newline + 1 : in.end;
+                in.binary = true;
+                if(in.raw<int32_t>(4) != 1) {
+                    std::cout << "Error: " << filepath << " has the wrong byte order" << std::endl;
+                    return false;
+                }
+            }
+            has_format = true;
+        } else if(name == "Nodes" && has_format) {
+            uint64_t n_blocks = in.size();
+            uint64_t n_nodes = in.size();
+            in.size();
+            uint64_t max_tag = in.size();
+            if(!in.ok || max_tag > (uint64_t(1) << 31)) {
+                std::cout << "Error: bad nodes header in " << filepath << std::endl;
+                return false;
+            }
+            tag_vertices.assign(max_tag + 1, -1);
+            vertices.reserve(vertices.size() + n_nodes);
+
+            std::vector<uint64_t> tags;
+            for(uint64_t b = 0; b < n_blocks && in.ok; b++) {
+                int entity_dim = in.integer();
+                in.integer();
+                int parametric = in.integer();
+                uint64_t n_block = in.size();
+                if(!in.ok || n_block > n_nodes) break;
+
+                tags.resize(n_block);
+                for(uint64_t &tag : tags) {
+                    tag = in.size();
+                }
+                for(uint64_t tag : tags) {
+                    Vector3d v;
+                    v[0] = in.real();
+                    v[1] = in.real();
+                    v[2] = in.real();
+                    for(int k = 0; k < (parametric ? entity_dim : 0); k++) {
+                        in.real();
+                    }
+                    if(!in.ok || tag > max_tag) {
+                        in.ok = false;
+                        break;
+                    }
+                    tag_vertices[tag] = vertices.size();
+                    vertices.push_back(v);
+                }
+            }
+            if(!in.ok) {
+                std::cout << "Error: " << filepath << " ends before all " << n_nodes << " nodes" << std::endl;
+                return false;
+            }
+        } else if(name == "Elements" && has_format) {
+            uint64_t n_blocks = in.size();
+            in.size();
+            in.size();
+            in.size();
+
+            for(uint64_t b = 0; b < n_blocks && in.ok; b++) {
+                in.integer();
+                in.integer();
+                int type = in.integer();
+                uint64_t n_block = in.size();
+                if(type < 1 || type > 31 || GMSH_ELEMENT_NODES[type] == 0) {
+                    std::cout << "Error: unknown element type " << type << " in " << filepath << std::endl;
+                    return false;
+                }
+
+                int n_element_nodes = GMSH_ELEMENT_NODES[type];
+                for(uint64_t e = 0; e < n_block && in.ok; e++) {
+                    in.size();
+                    Vector4i t;
+                    for(int k = 0; k < n_element_nodes; k++) {
+                        uint64_t tag = in.size();
+                        if(!in.ok || k >= 4 || !isGmshTet(type)) continue;
+
+                        if(tag >= tag_vertices.size() || tag_vertices[tag] < 0) {
+                            std::cout << "Error: element in " << filepath << " uses missing node " << tag << std::endl;
+                            return false;
+                        }
+                        t[k] = tag_vertices[tag];
+                    }
+                    if(in.ok && isGmshTet(type)) {
+                        tets.push_back(t);
+                    }
+                }
+            }
+            if(!in.ok) {
+                std::cout << "Error: " << filepath << " ends before all elements" << std::endl;
+                return false;
+            }
+        } else {
+            // sections that do not matter here are skipped whole
+            size_t found = contents.find("$End" + name, in.p - file.data());
+            if(found == std::string_view::npos) {
+                std::cout << "Error: " << filepath << " has no $End" << name << std::endl;
+                return false;
+            }
+            in.p = file.data() + found + name.size() + 4;
             continue;
         }
-        match = trxp.match(line);
-        if(match.hasMatch()) {
-            tets.emplace_back(match.captured(1).toInt(),
-                              match.captured(2).toInt(),
-                              match.captured(3).toInt(),
-                              match.captured(4).toInt());
+
+        // the section's end line
+        skipBlank(in.p, in.end);
+        std::string end_tag = "$End" + name;
+        if(contents.compare(in.p - file.data(), end_tag.size(), end_tag) != 0) {
+            std::cout << "Error: " << filepath << " has no " << end_tag << " where expected" << std::endl;
+            return false;
         }
+        in.p += end_tag.size();
+    }
+
+    if(!has_format) {
+        std::cout << "Error: " << filepath << " has no $MeshFormat" << std::endl;
+        return false;
     }
-    file.close();
+
     return true;
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <vector>
 #include "Eigen/Dense"
 #include "Eigen/StdVector"
@@ -9,7 +10,20 @@ EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Eigen::Matrix4i)
 class MeshLoader
 {
 public:
-    static bool loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
+    // picks the format from the extension: TetGen for .node or .ele (reading both files of that name), Gmsh 4.1 ascii or
+    // binary for .msh, a closed .obj surface filled with a lattice of lattice_resolution cubes across (see lattice.h),
+    // and the "v x y z" / "t a b c d" text format for anything else. tets index vertices from 0
+    static bool loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets,
+                            int lattice_resolution = 20);
+    // the files loadTetMesh reads for filepath
+    static std::vector<std::string> sourceFiles(const std::string &filepath);
+    // the triangles of a Wavefront .obj file, all of its groups in one, with polygons fanned into triangles. only
+    // positions are read
+    static bool loadTriMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector3i> &faces);
 private:
     MeshLoader();
+
+    static bool loadTextMesh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
+    static bool loadTetGen(const std::string &basepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
+    static bool loadGmsh(const std::string &filepath, std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
 };
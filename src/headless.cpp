@@ -0,0 +1,194 @@
+#include "scene.h"
+#include "parallel.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QSettings>
+#include <QStringList>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+
+// what a sweep can report about each run, computed once the run is over
+static const char *METRICS[] = {"wall_seconds", "steps_per_second", "contacts", "min_y", "com_x", "com_y", "com_z", "kinetic_energy", "max_speed"};
+
+static double metric(const std::string &name, FEMSystem &system, double wall_seconds, long n_steps) {
+    if(name == "wall_seconds") return wall_seconds;
+    if(name == "steps_per_second") return n_steps/wall_seconds;
+    if(name == "contacts") {
+        const FEMSystem::Stats &stats = system.getStats();
+        return stats.evaluations > 0 ? double(stats.contacts)/stats.evaluations : 0;
+    }
+
+    double mass = 0, kinetic_energy = 0, max_speed = 0;
+    double min_y = std::numeric_limits<double>::max();
+    Vector3d com(0,0,0);
+    for(int i = 0; i < system.getObjectCount(); i++) {
+        FEMObject &object = system.getObject(i);
+        VectorXd state = object.getState();
+        std::vector<double> masses = object.getMasses();
+        for(int k = 0; k < masses.size(); k++) {
+            Vector3d position = state.segment<3>(6*k);
+            Vector3d velocity = state.segment<3>(6*k+3);
+            mass += masses[k];
+            com += masses[k]*position;
+            kinetic_energy += 0.5*masses[k]*velocity.squaredNorm();
+            max_speed = std::max(max_speed, velocity.norm());
+            min_y = std::min(min_y, position.y());
+        }
+    }
+    com /= mass;
+
+    if(name == "min_y") return min_y;
+    if(name == "com_x") return com.x();
+    if(name == "com_y") return com.y();
+    if(name == "com_z") return com.z();
+    if(name == "kinetic_energy") return kinetic_energy;
+    return max_speed;
+}
+
+// one scene per combination of the swept values, run concurrently with one scene per core. the sweep file has the
+// same sections as a config, with a comma separated list of values for each swept key
+static int sweep(const QString &config, const QString &sweep_file, long n_steps, double duration, bool use_steps,
+                 const QStringList &metrics, const QString &output) {
+    QSettings sweep_settings(sweep_file, QSettings::IniFormat);
+    std::vector<std::string> keys;
+    std::vector<QStringList> values;
+    for(const QString &key : sweep_settings.allKeys()) {
+        keys.push_back(key.toStdString());
+        values.push_back(sweep_settings.value(key).toStringList());
+    }
+
+    for(const QString &m : metrics) {
+        if(std::find(std::begin(METRICS), std::end(METRICS), m.toStdString()) == std::end(METRICS)) {
+            std::cerr << "Unknown metric " << m.toStdString() << ", known are:";
+            for(const char *known : METRICS) std::cerr << " " << known;
+            std::cerr << std::endl;
+            return 1;
+        }
+    }
+
+    // every combination, the last key varying fastest
+    std::vector<std::map<std::string, std::string>> runs(1);
+    for(int k = 0; k < keys.size(); k++) {
+        std::vector<std::map<std::string, std::string>> expanded;
+        for(const std::map<std::string, std::string> &run : runs) {
+            for(const QString &v : values[k]) {
+                expanded.push_back(run);
+                expanded.back()[keys[k]] = v.toStdString();
+            }
+        }
+        runs.swap(expanded);
+    }
+
+    std::cout << "running " << runs.size() << " scenes on " << threadCount() << " threads" << std::endl;
+
+    std::vector<std::vector<double>> results(runs.size());
+    parallelFor(runs.size(), 1, [&](int begin, int end) {
+        for(int r = begin; r < end; r++) {
+            Scene scene;
+            scene.load(config, runs[r]);
+
+            long steps = use_steps ? n_steps : long(duration / scene.getTimestep());
+            auto start = std::chrono::steady_clock::now();
+            for(long i = 0; i < steps; i++) {
+                scene.step();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            for(const QString &m : metrics) {
+                results[r].push_back(metric(m.toStdString(), scene.getSystem(), seconds, steps));
+            }
+        }
+    });
+
+    std::ofstream file;
+    if(!output.isEmpty()) {
+        file.open(output.toStdString());
+        if(!file) {
+            std::cerr << "Error opening file: " << output.toStdString() << std::endl;
+            return 1;
+        }
+    }
+    std::ostream &out = output.isEmpty() ? std::cout : file;
+
+    out << "run";
+    for(const std::string &key : keys) out << "," << key;
+    for(const QString &m : metrics) out << "," << m.toStdString();
+    out << "\n";
+
+    out.precision(10);
+    for(int r = 0; r < runs.size(); r++) {
+        out << r;
+        for(const std::string &key : keys) out << "," << runs[r][key];
+        for(double v : results[r]) out << "," << v;
+        out << "\n";
+    }
+
+    return 0;
+}
+
+// steps a config's scene as fast as possible, without a window or an OpenGL context, and reports how fast it went
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("Simulation (headless)");
+    QCoreApplication::setOrganizationName("CS 2240");
+    QCoreApplication::setApplicationVersion(QT_VERSION_STR);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("config",  "Path of the config (.ini) file.");
+    QCommandLineOption stepsOption("steps", "Number of timesteps to run.", "steps");
+    QCommandLineOption durationOption("duration", "Simulated seconds to run, if --steps is not given (default 1).", "seconds", "1");
+    QCommandLineOption sweepOption("sweep", "Ini file of comma separated values to sweep over, runs every combination.", "file");
+    QCommandLineOption metricsOption("metrics", "Comma separated metrics to report per sweep run.", "names", "wall_seconds,com_y,kinetic_energy");
+    QCommandLineOption outputOption("output", "CSV file for the sweep results (default stdout).", "file");
+    parser.addOption(stepsOption);
+    parser.addOption(durationOption);
+    parser.addOption(sweepOption);
+    parser.addOption(metricsOption);
+    parser.addOption(outputOption);
+    parser.process(a);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 1) {
+        std::cerr << "Not enough arguments. Please provide a path to a config file (.ini) as a command-line argument." << std::endl;
+        return 1;
+    }
+
+    if(parser.isSet(sweepOption)) {
+        bool use_steps = parser.isSet(stepsOption);
+        return sweep(args[0], parser.value(sweepOption), use_steps ? parser.value(stepsOption).toLong() : 0, parser.value(durationOption).toDouble(),
+                     use_steps, parser.value(metricsOption).split(','), parser.value(outputOption));
+    }
+
+    Scene scene;
+    scene.load(args[0]);
+
+    long n_steps;
+    if(parser.isSet(stepsOption)) {
+        n_steps = parser.value(stepsOption).toLong();
+    } else {
+        n_steps = parser.value(durationOption).toDouble() / scene.getTimestep();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(long i = 0; i < n_steps; i++) {
+        scene.step();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double simulated = n_steps*scene.getTimestep();
+    std::cout << n_steps << " steps (" << simulated << " simulated seconds) in " << seconds << " s: "
+              << n_steps/seconds << " steps per second, " << simulated/seconds << "x real time" << std::endl;
+
+    if(scene.getReportStats()) {
+        scene.printStats();
+    }
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+#include "heightfield.h"
+#include "ccd.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+using namespace Eigen;
+
+HeightfieldCollider::HeightfieldCollider(const std::vector<double> &heights, int width, int depth, const Vector3d &origin, double cell_size, int id, double collision_penalty, double collision_epsilon) :
+    m_heights(heights),
+    m_width(width),
+    m_depth(depth),
+    m_origin(origin),
+    m_cell_size(cell_size)
+{
+    m_id = id;
+    m_collision_penalty = collision_penalty;
+    m_collision_epsilon = collision_epsilon;
+
+    m_bounds.reset();
+    for(int j = 0; j < m_depth; j++) {
+        for(int i = 0; i < m_width; i++) {
+            m_bounds.extend(sample(i, j));
+        }
+    }
+}
+
+// skips whitespace and # comments between the fields of a PGM header
+static void skipHeader(std::istream &in) {
+    while(in) {
+        int c = in.peek();
+        if(c == '#') {
+            std::string comment;
+            std::getline(in, comment);
+        } else if(std::isspace(c)) {
+            in.get();
+        } else {
+            return;
+        }
+    }
+}
+
+bool HeightfieldCollider::loadHeightmap(const std::string &filepath, int &width, int &depth, std::vector<double> &heights) {
+    std::ifstream in(filepath, std::ios::binary);
+    if(!in) {
+        std::cout << "Error opening file: " << filepath << std::endl;
+        return false;
+    }
+
+    char magic[2] = {0, 0};
+    in.read(magic, 2);
+
+    if(magic[0] == 'P' && (magic[1] == '5' || magic[1] == '2')) {
+        int max_value;
+        skipHeader(in);
+        in >> width;
+        skipHeader(in);
+        in >> depth;
+        skipHeader(in);
+        in >> max_value;
+        if(!in || width < 2 || depth < 2 || max_value <= 0 || max_value > 65535) {
+            std::cout << "Error: bad PGM header in " << filepath << std::endl;
+            return false;
+        }
+
+        heights.resize(width*depth);
+        if(magic[1] == '2') {
+            for(double &h : heights) {
+                int value;
+                in >> value;
+                h = double(value)/max_value;
+            }
+        } else {
+            // a single whitespace byte separates the header from the samples, which are big endian if 16 bit
+            in.get();
+            int bytes = max_value < 256 ? 1 : 2;
+            std::vector<unsigned char> data(size_t(width)*depth*bytes);
+            in.read(reinterpret_cast<char *>(data.data()), data.size());
+            for(size_t k = 0; k < heights.size(); k++) {
+                int value = bytes == 1 ? data[k] : (data[2*k] << 8) | data[2*k+1];
+                heights[k] = double(value)/max_value;
+            }
+        }
+
+        if(!in) {
+            std::cout << "Error: " << filepath << " ends before all " << width << "x" << depth << " samples" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // raw samples carry no size, so it has to be given and the sample size follows from the file size
+    if(width < 2 || depth < 2) {
+        std::cout << "Error: raw heightmap " << filepath << " needs a width and depth" << std::endl;
+        return false;
+    }
+
+    in.seekg(0, std::ios::end);
+    size_t size = in.tellg();
+    in.seekg(0);
+
+    size_t samples = size_t(width)*depth;
+    if(size != samples && size != 2*samples) {
+        std::cout << "Error: " << filepath << " is not " << width << "x" << depth << " 8 or 16 bit samples" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data(size);
+    in.read(reinterpret_cast<char *>(data.data()), size);
+
+    heights.resize(samples);
+    for(size_t k = 0; k < samples; k++) {
+        heights[k] = size == samples ? data[k]/255.0 : (data[2*k] | (data[2*k+1] << 8))/65535.0;
+    }
+    return true;
+}
+
+void HeightfieldCollider::getMesh(std::vector<Vector3d> &vertices, std::vector<Vector3i> &faces) {
+    vertices.clear();
+    faces.clear();
+
+    for(int j = 0; j < m_depth; j++) {
+        for(int i = 0; i < m_width; i++) {
+            vertices.push_back(sample(i, j));
+        }
+    }
+
+    for(int j = 0; j < m_depth - 1; j++) {
+        for(int i = 0; i < m_width - 1; i++) {
+            int a = j*m_width + i;
+            faces.emplace_back(a, a + m_width, a + m_width + 1);
+            faces.emplace_back(a, a + m_width + 1, a + 1);
+        }
+    }
+}
+
+// the two triangles of cell (i, j) are the ones getMesh makes, wound so their normals point up
+void HeightfieldCollider::triangle(int face, Vector3d &A, Vector3d &B, Vector3d &C) const {
+    int cell = face/2;
+    int i = cell % (m_width - 1);
+    int j = cell / (m_width - 1);
+
+    A = sample(i, j);
+    if(face % 2 == 0) {
+        B = sample(i, j+1);
+        C = sample(i+1, j+1);
+    } else {
+        B = sample(i+1, j+1);
+        C = sample(i+1, j);
+    }
+}
+
+Vector3d HeightfieldCollider::shellSample(int i, int j) const {
+    // central differences of the height, one sided at the border
+    int il = std::max(i-1, 0), ir = std::min(i+1, m_width-1);
+    int jl = std::max(j-1, 0), jr = std::min(j+1, m_depth-1);
+    double dhdx = (m_heights[j*m_width + ir] - m_heights[j*m_width + il]) / ((ir - il)*m_cell_size);
+    double dhdz = (m_heights[jr*m_width + i] - m_heights[jl*m_width + i]) / ((jr - jl)*m_cell_size);
+
+    return sample(i, j) - m_collision_epsilon*Vector3d(-dhdx, 1, -dhdz).normalized();
+}
+
+int HeightfieldCollider::locate(const Vector3d &point) const {
+    double x = (point.x() - m_origin.x())/m_cell_size;
+    double z = (point.z() - m_origin.z())/m_cell_size;
+    if(!(x >= 0 && z >= 0 && x <= m_width - 1 && z <= m_depth - 1)) return -1;
+
+    int i = std::min(int(x), m_width - 2);
+    int j = std::min(int(z), m_depth - 2);
+    int cell = j*(m_width - 1) + i;
+
+    // the diagonal runs from (i, j) to (i+1, j+1)
+    return 2*cell + (z - j >= x - i ? 0 : 1);
+}
+
+bool HeightfieldCollider::cellRange(const AABB &box, int &i0, int &i1, int &j0, int &j1) const {
+    if(!box.overlaps(m_bounds.expanded(m_collision_epsilon))) return false;
+
+    i0 = std::max(int(std::floor((box.min.x() - m_origin.x())/m_cell_size)), 0);
+    i1 = std::min(int(std::floor((box.max.x() - m_origin.x())/m_cell_size)), m_width - 2);
+    j0 = std::max(int(std::floor((box.min.z() - m_origin.z())/m_cell_size)), 0);
+    j1 = std::min(int(std::floor((box.max.z() - m_origin.z())/m_cell_size)), m_depth - 2);
+    return i0 <= i1 && j0 <= j1;
+}
+
+Vector3d HeightfieldCollider::getNormal(int face) {
+    Vector3d A, B, C;
+    triangle(face, A, B, C);
+    return (B - A).cross(C - A).normalized();
+}
+
+bool HeightfieldCollider::detectContact(const Vector3d &point, int &face, double &depth, double &clearance) {
+    // looking up the cell is as cheap as checking a hint, so the one passed in is ignored
+    face = locate(point);
+    if(face < 0 || point.y() > m_bounds.max.y() + m_collision_epsilon) {
+        face = -1;
+        clearance = m_bounds.distance(point) - m_collision_epsilon;
+        return false;
+    }
+
+    Vector3d A, B, C;
+    triangle(face, A, B, C);
+    double d = (point - A).dot((B - A).cross(C - A).normalized());
+
+    // the neighbouring cells can be closer than this face's plane, so there is no useful bound inside the terrain box
+    clearance = 0;
+    if(d > 0 || d < -m_collision_epsilon) {
+        face = -1;
+        return false;
+    }
+
+    depth = -d;
+    return true;
+}
+
+bool HeightfieldCollider::findContact(const Vector3d &point, double reach, double &depth, Vector3d &normal, Vector3d &velocity) {
+    // the terrain has no back side, so a point below its cell counts however deep it is, as long as it is within reach
+    int face = locate(point);
+    if(face < 0) return false;
+
+    normal = getNormal(face);
+    Vector3d A, B, C;
+    triangle(face, A, B, C);
+    depth = -(point - A).dot(normal);
+    if(depth < 0 || depth > std::max(reach, m_collision_epsilon)) return false;
+
+    velocity = Vector3d(0,0,0);
+    return true;
+}
+
+double HeightfieldCollider::vertexImpact(const Vector3d &p0, const Vector3d &p1, Vector3d &normal) {
+    AABB box;
+    box.extend(p0);
+    box.extend(p1);
+
+    int i0, i1, j0, j1;
+    if(!cellRange(box, i0, i1, j0, j1)) return NO_IMPACT;
+
+    double impact = NO_IMPACT;
+    for(int j = j0; j <= j1; j++) {
+        for(int i = i0; i <= i1; i++) {
+            Vector3d a = shellSample(i, j), b = shellSample(i, j+1), c = shellSample(i+1, j+1), d = shellSample(i+1, j);
+            Vector3d n;
+            double t = vertexTriangleImpact(p0, p1, a, a, b, b, c, c, n);
+            if(t < impact) {
+                impact = t;
+                normal = n;
+            }
+            t = vertexTriangleImpact(p0, p1, a, a, c, c, d, d, n);
+            if(t < impact) {
+                impact = t;
+                normal = n;
+            }
+        }
+    }
+    return impact;
+}
+
+double HeightfieldCollider::edgeImpact(const Vector3d &p0, const Vector3d &p1, const Vector3d &q0, const Vector3d &q1, Vector3d &normal) {
+    AABB box;
+    box.extend(p0);
+    box.extend(p1);
+    box.extend(q0);
+    box.extend(q1);
+
+    int i0, i1, j0, j1;
+    if(!cellRange(box, i0, i1, j0, j1)) return NO_IMPACT;
+
+    // every edge of every cell in range with the third corner of a triangle it belongs to, wound like the triangles.
+    // the ones shared by two cells get tested twice
+    double impact = NO_IMPACT;
+    for(int j = j0; j <= j1; j++) {
+        for(int i = i0; i <= i1; i++) {
+            Vector3d a = shellSample(i, j), b = shellSample(i, j+1), c = shellSample(i+1, j+1), d = shellSample(i+1, j);
+            const Vector3d *edges[5][3] = {{&a, &b, &c}, {&b, &c, &a}, {&c, &d, &a}, {&d, &a, &c}, {&a, &c, &d}};
+            for(auto &e : edges) {
+                Vector3d n;
+                double t = edgeEdgeImpact(p0, p1, q0, q1, *e[0], *e[0], *e[1], *e[1], *e[2], *e[2], n);
+                if(t < impact) {
+                    impact = t;
+                    normal = n;
+                }
+            }
+        }
+    }
+    return impact;
+}
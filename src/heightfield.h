@@ -0,0 +1,58 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+#include "collider.h"
+
+// static terrain given by heights on a regular grid in the xz plane. sample (i, j) sits at
+// origin + (i*cell_size, heights[j*width + i], j*cell_size), and each grid cell is split into two triangles
+// along its diagonal. a query only ever looks at the cell under the point, so it costs the same however
+// large the grid is
+class HeightfieldCollider : public Collider
+{
+public:
+    HeightfieldCollider(const std::vector<double> &heights, int width, int depth, const Eigen::Vector3d &origin, double cell_size, int id, double collision_penalty, double collision_epsilon);
+
+    // reads a binary (P5) or ascii (P2) PGM, or headerless 8 or 16 bit little endian raw samples of the given
+    // width and depth. heights are scaled to [0, 1]
+    static bool loadHeightmap(const std::string &filepath, int &width, int &depth, std::vector<double> &heights);
+
+    // the triangles of the terrain, for drawing
+    void getMesh(std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector3i> &faces);
+
+    bool detectContact(const Eigen::Vector3d &point, int &face, double &depth, double &clearance) override;
+    bool findContact(const Eigen::Vector3d &point, double reach, double &depth, Eigen::Vector3d &normal, Eigen::Vector3d &velocity) override;
+    void update() override {}
+
+    // the terrain never moves, so there is nothing to record per step
+    void beginSweep() override {}
+    void updateSweep() override {}
+    AABB getSweptBounds() override {return m_bounds.expanded(m_collision_epsilon);}
+    double vertexImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, Eigen::Vector3d &normal) override;
+    double edgeImpact(const Eigen::Vector3d &p0, const Eigen::Vector3d &p1, const Eigen::Vector3d &q0, const Eigen::Vector3d &q1,
+                      Eigen::Vector3d &normal) override;
+
+    Eigen::Vector3d getNormal(int face) override;
+
+private:
+    Eigen::Vector3d sample(int i, int j) const {
+        return m_origin + Eigen::Vector3d(i*m_cell_size, m_heights[j*m_width + i], j*m_cell_size);
+    }
+    // sample (i, j) pushed in by epsilon along its normal, the inner shell used for continuous collision
+    Eigen::Vector3d shellSample(int i, int j) const;
+    void triangle(int face, Eigen::Vector3d &A, Eigen::Vector3d &B, Eigen::Vector3d &C) const;
+    // face whose xz projection contains point, or -1 if it is outside the grid
+    int locate(const Eigen::Vector3d &point) const;
+    // cells overlapping box in the xz plane, false if there are none
+    bool cellRange(const AABB &box, int &i0, int &i1, int &j0, int &j1) const;
+
+    std::vector<double> m_heights;
+    int m_width;
+    int m_depth;
+    Eigen::Vector3d m_origin;
+    double m_cell_size;
+};
+
+#endif // HEIGHTFIELD_H
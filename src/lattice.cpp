@@ -0,0 +1,116 @@
+#include "lattice.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace Eigen;
+
+// the six tets of a cube, as corners x + 2y + 4z, going from corner 0 to corner 7 along one axis at a time. odd
+// orders of the axes have two corners swapped so that every tet has positive volume
+static const int CUBE_TETS[6][4] = {
+    {0, 1, 3, 7},
+    {0, 3, 2, 7},
+    {0, 2, 6, 7},
+    {0, 6, 4, 7},
+    {0, 4, 5, 7},
+    {0, 5, 1, 7}
+};
+
+bool tetrahedralizeLattice(const std::vector<Vector3d> &surfaceVertices, const std::vector<Vector3i> &surfaceFaces, int resolution,
+                           std::vector<Vector3d> &vertices, std::vector<Vector4i> &tets) {
+    vertices.clear();
+    tets.clear();
+    if(surfaceVertices.empty() || surfaceFaces.empty() || resolution < 1) return false;
+
+    Vector3d lo = surfaceVertices[0];
+    Vector3d hi = surfaceVertices[0];
+    for(const Vector3d &v : surfaceVertices) {
+        lo = lo.cwiseMin(v);
+        hi = hi.cwiseMax(v);
+    }
+
+    // the grid is centered on the bounding box and covers it
+    double h = (hi - lo).maxCoeff()/resolution;
+    if(!(h > 0)) return false;
+    Vector3i n;
+    for(int a = 0; a < 3; a++) {
+        n[a] = std::max(1, int(std::ceil((hi[a] - lo[a])/h - 1e-9)));
+    }
+    Vector3d origin = (lo + hi)/2 - n.cast<double>()*h/2;
+
+    // every row of cube centers along x is a ray, and a center is inside if the ray crosses the surface an odd number
+    // of times before it. the rays are nudged off the centers by a tiny odd amount so they do not run exactly through
+    // an edge or vertex of a surface laid out on the grid
+    const double nudge_y = 1.234567e-7*h;
+    const double nudge_z = 2.345678e-7*h;
+    std::vector<std::vector<double>> crossings(n[1]*n[2]);
+    for(const Vector3i &face : surfaceFaces) {
+        const Vector3d &a = surfaceVertices[face[0]];
+        const Vector3d &b = surfaceVertices[face[1]];
+        const Vector3d &c = surfaceVertices[face[2]];
+
+        double area = (b[1] - a[1])*(c[2] - a[2]) - (c[1] - a[1])*(b[2] - a[2]);
+        if(area == 0) continue;
+
+        int j0 = std::max(0, int(std::floor((std::min({a[1], b[1], c[1]}) - origin[1])/h - 0.5)));
+        int j1 = std::min(n[1] - 1, int(std::ceil((std::max({a[1], b[1], c[1]}) - origin[1])/h - 0.5)));
+        int k0 = std::max(0, int(std::floor((std::min({a[2], b[2], c[2]}) - origin[2])/h - 0.5)));
+        int k1 = std::min(n[2] - 1, int(std::ceil((std::max({a[2], b[2], c[2]}) - origin[2])/h - 0.5)));
+        for(int k = k0; k <= k1; k++) {
+            for(int j = j0; j <= j1; j++) {
+                double y = origin[1] + (j + 0.5)*h + nudge_y;
+                double z = origin[2] + (k + 0.5)*h + nudge_z;
+
+                // barycentric coordinates of the ray in the triangle seen along x
+                double wa = ((b[1] - y)*(c[2] - z) - (c[1] - y)*(b[2] - z))/area;
+                double wb = ((c[1] - y)*(a[2] - z) - (a[1] - y)*(c[2] - z))/area;
+                double wc = 1 - wa - wb;
+                if(wa < 0 || wb < 0 || wc < 0) continue;
+
+                crossings[k*n[1] + j].push_back(wa*a[0] + wb*b[0] + wc*c[0]);
+            }
+        }
+    }
+
+    std::vector<char> inside(n[0]*n[1]*n[2], 0);
+    for(int k = 0; k < n[2]; k++) {
+        for(int j = 0; j < n[1]; j++) {
+            std::vector<double> &row = crossings[k*n[1] + j];
+            std::sort(row.begin(), row.end());
+            for(int r = 0; r + 1 < row.size(); r += 2) {
+                int i0 = std::max(0, int(std::ceil((row[r] - origin[0])/h - 0.5)));
+                int i1 = std::min(n[0] - 1, int(std::floor((row[r+1] - origin[0])/h - 0.5)));
+                for(int i = i0; i <= i1; i++) {
+                    inside[(k*n[1] + j)*n[0] + i] = 1;
+                }
+            }
+        }
+    }
+
+    // grid corners get vertex numbers in the order the cubes first use them
+    Vector3i m = n.array() + 1;
+    std::vector<int> corner_vertex(m[0]*m[1]*m[2], -1);
+    for(int k = 0; k < n[2]; k++) {
+        for(int j = 0; j < n[1]; j++) {
+            for(int i = 0; i < n[0]; i++) {
+                if(!inside[(k*n[1] + j)*n[0] + i]) continue;
+
+                int corners[8];
+                for(int c = 0; c < 8; c++) {
+                    Vector3i g(i + (c & 1), j + ((c >> 1) & 1), k + ((c >> 2) & 1));
+                    int &v = corner_vertex[(g[2]*m[1] + g[1])*m[0] + g[0]];
+                    if(v < 0) {
+                        v = vertices.size();
+                        vertices.push_back(origin + g.cast<double>()*h);
+                    }
+                    corners[c] = v;
+                }
+
+                for(const int *tet : CUBE_TETS) {
+                    tets.emplace_back(corners[tet[0]], corners[tet[1]], corners[tet[2]], corners[tet[3]]);
+                }
+            }
+        }
+    }
+
+    return !tets.empty();
+}
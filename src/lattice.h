@@ -0,0 +1,12 @@
+#ifndef LATTICE_H
+#define LATTICE_H
+#include <vector>
+#include "Eigen/Dense"
+
+// fills a closed triangle surface with a grid of equal cubes, resolution of them along the longest side of its bounding
+// box, keeping the cubes whose centers are inside it. each cube is cut into the same six tets along its main diagonal,
+// so neighbouring cubes share faces and every tet has one of six rest shapes. false if no cube is inside
+bool tetrahedralizeLattice(const std::vector<Eigen::Vector3d> &surfaceVertices, const std::vector<Eigen::Vector3i> &surfaceFaces, int resolution,
+                           std::vector<Eigen::Vector3d> &vertices, std::vector<Eigen::Vector4i> &tets);
+
+#endif // LATTICE_H
@@ -0,0 +1,51 @@
+#include "mappedfile.h"
+#include <fstream>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string &filepath)
+{
+#ifndef _WIN32
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if(fd < 0) return;
+
+    struct stat st;
+    if(::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void *p = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p != MAP_FAILED) {
+            m_data = static_cast<const char *>(p);
+            m_size = st.st_size;
+            m_mapped = true;
+            m_open = true;
+        }
+    }
+    ::close(fd);
+    if(m_open) return;
+#endif
+
+    std::ifstream in(filepath, std::ios::binary);
+    if(!in) return;
+
+    in.seekg(0, std::ios::end);
+    m_buffer.resize(size_t(in.tellg()));
+    in.seekg(0);
+    in.read(m_buffer.data(), m_buffer.size());
+
+    m_data = m_buffer.data();
+    m_size = m_buffer.size();
+    m_open = bool(in);
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+    if(m_mapped) {
+        ::munmap(const_cast<char *>(m_data), m_size);
+    }
+#endif
+}
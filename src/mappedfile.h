@@ -0,0 +1,31 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <vector>
+
+// the bytes of a whole file, read only. memory mapped where the platform has mmap, so nothing is copied and pages are
+// only read when touched, and read into memory everywhere else
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &filepath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool isOpen() const {return m_open;}
+    const char *data() const {return m_data;}
+    size_t size() const {return m_size;}
+
+private:
+    bool m_open = false;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    // only used without mmap, or for empty files which cannot be mapped
+    std::vector<char> m_buffer;
+    bool m_mapped = false;
+};
+
+#endif // MAPPEDFILE_H
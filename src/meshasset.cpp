@@ -0,0 +1,724 @@
+#include "meshasset.h"
+#include "extractfaces.h"
+#include "graphics/meshloader.h"
+#include "mappedfile.h"
+#include "aabb.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace Eigen;
+
+static double calculateTetrahedronVolume(const Vector3d &v0, const Vector3d &v1, const Vector3d &v2, const Vector3d &v3) {
+    Vector3d a = v1 - v0;
+    Vector3d b = v2 - v0;
+    Vector3d c = v3 - v0;
+
+    double volume = a.dot(b.cross(c));
+
+    return std::abs(volume) / 6.0;
+}
+
+static Vector3d calculateAreaWeightedNormal(const Vector3i &f, const std::vector<Vector3d> &positions) {
+    Vector3d e1 = positions[f[1]] - positions[f[0]];
+    Vector3d e2 = positions[f[2]] - positions[f[0]];
+    return .5*e1.cross(e2);
+}
+
+// FNV-1a style 64 bit hash taking 8 bytes at a time, continuing from hash. only used to tell inputs apart
+static uint64_t hashBytes(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 32;
+    }
+    for(; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// a tet's rest shape, as its edges from vertex 0 in multiples of a small length
+typedef std::array<int64_t, 9> ShapeKey;
+
+struct ShapeKeyHash {
+    size_t operator()(const ShapeKey &key) const {
+        return hashBytes(key.data(), sizeof(key));
+    }
+};
+
+// tets per block. with their rest shape, normals and indices, and their nodes, a block is about 250 KB
+static const int BLOCK_TETS = 1024;
+
+// splits the tets into blocks of up to BLOCK_TETS and returns the tets in block order. each block is grown breadth first
+// across shared faces, which keeps it compact, from a tet next to the previous block, or the first free one if there
+// is none. it takes in further parts of the mesh until it is full
+static std::vector<int> partitionTets(int n_tets, const std::vector<int> &face_neighbors, std::vector<int> &block_offsets) {
+    std::vector<int> order;
+    order.reserve(n_tets);
+    std::vector<char> taken(n_tets, 0);
+    std::vector<int> queue, frontier;
+    int first_free = 0;
+
+    block_offsets.assign(1, 0);
+    while(order.size() < n_tets) {
+        while(order.size() - block_offsets.back() < BLOCK_TETS && order.size() < n_tets) {
+            int seed = -1;
+            for(int t : frontier) {
+                if(!taken[t]) {
+                    seed = t;
+                    break;
+                }
+            }
+            if(seed < 0) {
+                while(taken[first_free]) first_free++;
+                seed = first_free;
+            }
+
+            queue.assign(1, seed);
+            taken[seed] = 1;
+            size_t head = 0;
+            while(head < queue.size() && order.size() - block_offsets.back() < BLOCK_TETS) {
+                int t = queue[head++];
+                order.push_back(t);
+                for(int k = 0; k < 4; k++) {
+                    int neighbor = face_neighbors[4*t + k];
+                    if(neighbor < 0 || taken[neighbor]) continue;
+                    taken[neighbor] = 1;
+                    queue.push_back(neighbor);
+                }
+            }
+
+            // tets queued but not reached are left for the next block to start from
+            frontier.assign(queue.begin() + head, queue.end());
+            for(int t : frontier) {
+                taken[t] = 0;
+            }
+        }
+        block_offsets.push_back(order.size());
+    }
+    return order;
+}
+
+// finds the nodes touched by more than one block and gives every block touching them a slot of its own
+static void assignSlots(MeshAsset &asset) {
+    int n_blocks = asset.block_offsets.size() - 1;
+    std::vector<int> node_block(asset.rest_positions.size(), -1);
+    std::vector<char> boundary(asset.rest_positions.size(), 0);
+    for(int b = 0; b < n_blocks; b++) {
+        for(int t = asset.block_offsets[b]; t < asset.block_offsets[b+1]; t++) {
+            for(int i = 0; i < 4; i++) {
+                int node = asset.tets[t][i];
+                if(node_block[node] >= 0 && node_block[node] != b) boundary[node] = 1;
+                node_block[node] = b;
+            }
+        }
+    }
+
+    // (node, block) of every boundary node and block touching it, sorted, is the slot order
+    std::vector<std::pair<int, int>> slots;
+    for(int b = 0; b < n_blocks; b++) {
+        for(int t = asset.block_offsets[b]; t < asset.block_offsets[b+1]; t++) {
+            for(int i = 0; i < 4; i++) {
+                if(boundary[asset.tets[t][i]]) slots.emplace_back(asset.tets[t][i], b);
+            }
+        }
+    }
+    std::sort(slots.begin(), slots.end());
+    slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+    asset.tet_slots = asset.tets;
+    for(int b = 0; b < n_blocks; b++) {
+        for(int t = asset.block_offsets[b]; t < asset.block_offsets[b+1]; t++) {
+            for(int i = 0; i < 4; i++) {
+                int node = asset.tets[t][i];
+                if(!boundary[node]) continue;
+                int s = std::lower_bound(slots.begin(), slots.end(), std::make_pair(node, b)) - slots.begin();
+                asset.tet_slots[t][i] = -1 - s;
+            }
+        }
+    }
+
+    asset.boundary_nodes.clear();
+    asset.boundary_offsets.assign(1, 0);
+    for(int s = 0; s < slots.size(); s++) {
+        if(s > 0 && slots[s].first == slots[s-1].first) continue;
+        if(s > 0) asset.boundary_offsets.push_back(s);
+        asset.boundary_nodes.push_back(slots[s].first);
+    }
+    if(!slots.empty()) asset.boundary_offsets.push_back(slots.size());
+}
+
+std::shared_ptr<const MeshAsset> MeshAsset::build(const std::vector<Vector3d> &rest_positions, const std::vector<Vector4i> &tets, double density) {
+    std::shared_ptr<MeshAsset> asset = std::make_shared<MeshAsset>();
+    asset->rest_positions = rest_positions;
+
+    std::vector<Vector3i> file_tet_faces;
+    std::vector<int> face_neighbors;
+    extractFaces(tets, rest_positions, asset->surface_faces, file_tet_faces, face_neighbors);
+
+    std::vector<int> block_order = partitionTets(tets.size(), face_neighbors, asset->block_offsets);
+    // within a block the tets go by their lowest node, so the nodes they touch are walked through roughly in order
+    for(int b = 0; b + 1 < asset->block_offsets.size(); b++) {
+        std::stable_sort(block_order.begin() + asset->block_offsets[b], block_order.begin() + asset->block_offsets[b+1], [&](int x, int y) {
+            return tets[x].minCoeff() < tets[y].minCoeff();
+        });
+    }
+    std::vector<Vector3i> tet_faces(file_tet_faces.size());
+    asset->tets.resize(tets.size());
+    for(int t = 0; t < tets.size(); t++) {
+        asset->tets[t] = tets[block_order[t]];
+        for(int k = 0; k < 4; k++) {
+            tet_faces[4*t + k] = file_tet_faces[4*block_order[t] + k];
+        }
+    }
+    assignSlots(*asset);
+
+    // tets that are translated copies of each other, like the cubes of a lattice, share one rest shape. they are
+    // matched by their edges from vertex 0, rounded to a billionth of the mesh's size
+    AABB bounds;
+    for(const Vector3d &p : rest_positions) {
+        bounds.extend(p);
+    }
+    double quantum = rest_positions.empty() ? 1 : std::max(1e-9*(bounds.max - bounds.min).norm(), std::numeric_limits<double>::min());
+    std::unordered_map<ShapeKey, int, ShapeKeyHash> shapes;
+
+    asset->masses.assign(rest_positions.size(), 0);
+    asset->tet_shapes.resize(asset->tets.size());
+    for(int t = 0; t < asset->tets.size(); t++) {
+        const Vector4i &tet = asset->tets[t];
+        const Vector3d &v0 = rest_positions[tet[0]];
+        const Vector3d &v1 = rest_positions[tet[1]];
+        const Vector3d &v2 = rest_positions[tet[2]];
+        const Vector3d &v3 = rest_positions[tet[3]];
+
+        double t_mass = density * calculateTetrahedronVolume(v0, v1, v2, v3);
+        for(int i = 0; i < 4; i++) {
+            asset->masses[tet[i]] += t_mass/4;
+        }
+
+        ShapeKey key;
+        for(int i = 0; i < 3; i++) {
+            for(int d = 0; d < 3; d++) {
+                key[3*i + d] = std::llround((rest_positions[tet[i+1]][d] - v0[d])/quantum);
+            }
+        }
+        auto shape = shapes.emplace(key, asset->betas.size());
+        asset->tet_shapes[t] = shape.first->second;
+        if(!shape.second) continue;
+
+        Matrix<double, 3, 4> normals = Matrix<double, 3, 4>::Zero();
+        for(int i = 0; i < 4; i++) {
+            for(int k = 0; k < 4; k++) {
+                const Vector3i &f = tet_faces[4*t + k];
+                if(tet[i] == f[0] || tet[i] == f[1] || tet[i] == f[2]) {
+                    normals.col(i) += calculateAreaWeightedNormal(f, rest_positions);
+                }
+            }
+        }
+        asset->tet_normals.push_back(normals);
+
+        Matrix4d m;
+        m << v0.x(), v1.x(), v2.x(), v3.x(),
+             v0.y(), v1.y(), v2.y(), v3.y(),
+             v0.z(), v1.z(), v2.z(), v3.z(),
+             1,      1,      1,      1;
+        asset->betas.push_back(m.inverse().leftCols<3>());
+    }
+
+    for(double mass : asset->masses) {
+        asset->inverse_masses.push_back(1/mass);
+    }
+
+    extractSurfaceVertices(asset->surface_faces, asset->surface_nodes);
+
+    for(const Vector3i &face : asset->surface_faces) {
+        for(int k = 0; k < 3; k++) {
+            int a = face[k], b = face[(k+1)%3];
+            asset->surface_edges.emplace_back(std::min(a, b), std::max(a, b));
+        }
+    }
+    std::vector<Vector2i> &edges = asset->surface_edges;
+    std::sort(edges.begin(), edges.end(), [](const Vector2i &a, const Vector2i &b) {
+        return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);
+    });
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    const std::vector<int> &surface_nodes = asset->surface_nodes;
+    auto surfaceIndex = [&](int node) {
+        return std::lower_bound(surface_nodes.begin(), surface_nodes.end(), node) - surface_nodes.begin();
+    };
+
+    std::vector<std::vector<int>> rings(surface_nodes.size());
+    for(int k = 0; k < surface_nodes.size(); k++) {
+        rings[k].push_back(surface_nodes[k]);
+    }
+    for(const Vector2i &e : edges) {
+        rings[surfaceIndex(e[0])].push_back(e[1]);
+        rings[surfaceIndex(e[1])].push_back(e[0]);
+    }
+
+    asset->ring_offsets.push_back(0);
+    for(std::vector<int> &ring : rings) {
+        std::sort(ring.begin(), ring.end());
+        asset->ring.insert(asset->ring.end(), ring.begin(), ring.end());
+        asset->ring_offsets.push_back(asset->ring.size());
+    }
+
+    return asset;
+}
+
+// bump whenever the layout below or anything build computes changes, so old cache files are rebuilt
+static const uint32_t CACHE_VERSION = 6;
+static const char CACHE_MAGIC[8] = {'F', 'E', 'M', 'A', 'S', 'S', 'E', 'T'};
+static const int CACHE_ARRAYS = 16;
+static const char CACHE_PADDING[16] = {};
+
+// a header with the element count of each array and a hash of their bytes, then the arrays in the order of
+// cacheArrays, each starting on a 16 byte boundary. integers and doubles are stored as they are in memory, the byte
+// order check rejects files from machines that differ
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t key;
+    uint64_t checksum;
+    uint64_t counts[CACHE_ARRAYS];
+};
+
+// the bytes and element size of every array of an asset, in file order
+template<typename Asset, typename F>
+static void cacheArrays(Asset &asset, F f) {
+    f(asset.rest_positions);
+    f(asset.tets);
+    f(asset.masses);
+    f(asset.inverse_masses);
+    f(asset.tet_shapes);
+    f(asset.betas);
+    f(asset.tet_normals);
+    f(asset.block_offsets);
+    f(asset.tet_slots);
+    f(asset.boundary_nodes);
+    f(asset.boundary_offsets);
+    f(asset.surface_faces);
+    f(asset.surface_nodes);
+    f(asset.surface_edges);
+    f(asset.ring_offsets);
+    f(asset.ring);
+}
+
+static size_t alignCache(size_t offset) {
+    return (offset + 15) & ~size_t(15);
+}
+
+// whether every index in an asset points into the array it indexes, so that a damaged cache file which still
+// matches its checksum cannot make the simulation read out of bounds
+static bool validAsset(const MeshAsset &asset) {
+    size_t n_nodes = asset.rest_positions.size();
+    size_t n_tets = asset.tets.size();
+    auto node = [&](int i) {return i >= 0 && size_t(i) < n_nodes;};
+    auto offsets = [](const std::vector<int> &offsets, size_t size) {
+        if(offsets.empty() || offsets.front() != 0 || size_t(offsets.back()) != size) return false;
+        return std::is_sorted(offsets.begin(), offsets.end());
+    };
+
+    if(asset.masses.size() != n_nodes || asset.inverse_masses.size() != n_nodes) return false;
+    if(asset.tet_shapes.size() != n_tets || asset.tet_slots.size() != n_tets) return false;
+    if(asset.betas.size() != asset.tet_normals.size()) return false;
+    if(!offsets(asset.block_offsets, n_tets)) return false;
+    if(asset.boundary_offsets.size() != asset.boundary_nodes.size() + 1 || asset.boundary_offsets.front() != 0) return false;
+    if(!std::is_sorted(asset.boundary_offsets.begin(), asset.boundary_offsets.end())) return false;
+    if(asset.ring_offsets.size() != asset.surface_nodes.size() + 1 || !offsets(asset.ring_offsets, asset.ring.size())) return false;
+
+    int n_slots = asset.boundary_offsets.back();
+    for(size_t t = 0; t < n_tets; t++) {
+        for(int i = 0; i < 4; i++) {
+            if(!node(asset.tets[t][i])) return false;
+            int slot = asset.tet_slots[t][i];
+            if(slot >= 0 ? !node(slot) : -1 - slot >= n_slots) return false;
+        }
+        if(asset.tet_shapes[t] < 0 || size_t(asset.tet_shapes[t]) >= asset.betas.size()) return false;
+    }
+    for(const Vector3i &face : asset.surface_faces) {
+        if(!node(face[0]) || !node(face[1]) || !node(face[2])) return false;
+    }
+    for(const Vector2i &edge : asset.surface_edges) {
+        if(!node(edge[0]) || !node(edge[1])) return false;
+    }
+    return std::all_of(asset.boundary_nodes.begin(), asset.boundary_nodes.end(), node) &&
+           std::all_of(asset.surface_nodes.begin(), asset.surface_nodes.end(), node) &&
+           std::all_of(asset.ring.begin(), asset.ring.end(), node);
+}
+
+std::shared_ptr<const MeshAsset> MeshAsset::readCache(const std::string &path, uint64_t key) {
+    MappedFile file(path);
+    if(!file.isOpen() || file.size() < sizeof(CacheHeader)) return nullptr;
+
+    CacheHeader header;
+    std::memcpy(&header, file.data(), sizeof(header));
+    if(std::memcmp(header.magic, CACHE_MAGIC, 8) != 0 || header.version != CACHE_VERSION || header.byte_order != 0x01020304 || header.key != key) return nullptr;
+
+    // the arrays are copied straight out of the mapping, there is nothing to parse. anything that does not add up
+    // fails the read, and the asset is built again instead
+    std::shared_ptr<MeshAsset> asset = std::make_shared<MeshAsset>();
+    size_t offset = alignCache(sizeof(header));
+    uint64_t checksum = hashBytes(nullptr, 0);
+    int k = 0;
+    bool complete = true;
+    cacheArrays(*asset, [&](auto &array) {
+        uint64_t count = header.counts[k++];
+        if(!complete || offset > file.size() || count > (file.size() - offset)/sizeof(array[0])) {
+            complete = false;
+            return;
+        }
+        size_t bytes = count*sizeof(array[0]);
+        array.resize(count);
+        std::memcpy(static_cast<void *>(array.data()), file.data() + offset, bytes);
+        checksum = hashBytes(file.data() + offset, bytes, checksum);
+        offset = alignCache(offset + bytes);
+    });
+    if(!complete || checksum != header.checksum || !validAsset(*asset)) return nullptr;
+
+    return asset;
+}
+
+static long processId() {
+#ifdef _WIN32
+    return _getpid();
+#else
+    return getpid();
+#endif
+}
+
+bool MeshAsset::writeCache(const std::string &path, uint64_t key, const MeshAsset &asset) {
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, 8);
+    header.version = CACHE_VERSION;
+    header.byte_order = 0x01020304;
+    header.key = key;
+    header.checksum = hashBytes(nullptr, 0);
+    int k = 0;
+    cacheArrays(asset, [&](const auto &array) {
+        header.counts[k++] = array.size();
+        header.checksum = hashBytes(array.data(), array.size()*sizeof(array[0]), header.checksum);
+    });
+
+    // written next to the final file under a name no other writer uses, in this process or another, and renamed over
+    // it, so a reader never sees half of one and two writers never write into the same file
+    static std::atomic<unsigned> temp_count(0);
+    std::string temp_path = path + "." + std::to_string(processId()) + "-" + std::to_string(temp_count++) + ".tmp";
+    std::ofstream out(temp_path, std::ios::binary);
+    if(!out) return false;
+
+    size_t offset = sizeof(header);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    cacheArrays(asset, [&](const auto &array) {
+        out.write(CACHE_PADDING, alignCache(offset) - offset);
+        offset = alignCache(offset);
+        out.write(reinterpret_cast<const char *>(array.data()), array.size()*sizeof(array[0]));
+        offset += array.size()*sizeof(array[0]);
+    });
+    out.close();
+
+    std::error_code error;
+    if(!out || (std::filesystem::rename(temp_path, path, error), error)) {
+        std::filesystem::remove(temp_path, error);
+        return false;
+    }
+    return true;
+}
+
+// the nodes sharing a tet with each node, node i's are neighbors[offsets[i]] to neighbors[offsets[i+1]], sorted
+static void nodeGraph(int n_nodes, const std::vector<Vector4i> &tets, std::vector<int> &offsets, std::vector<int> &neighbors) {
+    std::vector<std::pair<int, int>> edges;
+    edges.reserve(12*tets.size());
+    for(const Vector4i &tet : tets) {
+        for(int a = 0; a < 4; a++) {
+            for(int b = 0; b < 4; b++) {
+                if(a != b) edges.emplace_back(tet[a], tet[b]);
+            }
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    offsets.assign(n_nodes + 1, 0);
+    neighbors.resize(edges.size());
+    for(int e = 0; e < edges.size(); e++) {
+        offsets[edges[e].first + 1]++;
+        neighbors[e] = edges[e].second;
+    }
+    for(int i = 0; i < n_nodes; i++) {
+        offsets[i+1] += offsets[i];
+    }
+}
+
+// new index of every node in reverse Cuthill-McKee order. each connected part is walked breadth first from a node
+// far out on it, visiting neighbours by increasing degree, which keeps every node's neighbours close to it
+static std::vector<int> cuthillMcKee(int n_nodes, const std::vector<Vector4i> &tets) {
+    std::vector<int> offsets, neighbors;
+    nodeGraph(n_nodes, tets, offsets, neighbors);
+    auto degree = [&](int i) {return offsets[i+1] - offsets[i];};
+
+    std::vector<int> order;
+    order.reserve(n_nodes);
+    std::vector<char> visited(n_nodes, 0);
+    std::vector<int> level(n_nodes, -1);
+
+    // breadth first from start, appending the nodes it reaches to out, returns the last one
+    auto walk = [&](int start, std::vector<int> &out, std::vector<char> &seen) {
+        size_t head = out.size();
+        out.push_back(start);
+        seen[start] = 1;
+        std::vector<int> next;
+        while(head < out.size()) {
+            int i = out[head++];
+            next.assign(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i+1]);
+            std::stable_sort(next.begin(), next.end(), [&](int a, int b) {return degree(a) < degree(b);});
+            for(int j : next) {
+                if(seen[j]) continue;
+                seen[j] = 1;
+                out.push_back(j);
+            }
+        }
+        return out.back();
+    };
+
+    std::vector<int> nodes_by_degree(n_nodes);
+    for(int i = 0; i < n_nodes; i++) nodes_by_degree[i] = i;
+    std::stable_sort(nodes_by_degree.begin(), nodes_by_degree.end(), [&](int a, int b) {return degree(a) < degree(b);});
+
+    std::vector<int> part;
+    std::vector<char> in_part(n_nodes, 0);
+    for(int seed : nodes_by_degree) {
+        if(visited[seed]) continue;
+
+        // the node a walk from the lowest degree node ends on is about as far out as it gets, start from there
+        part.clear();
+        int start = walk(seed, part, in_part);
+        for(int i : part) in_part[i] = 0;
+
+        walk(start, order, visited);
+    }
+
+    std::vector<int> new_index(n_nodes);
+    for(int k = 0; k < n_nodes; k++) {
+        new_index[order[n_nodes - 1 - k]] = k;
+    }
+    return new_index;
+}
+
+// spreads the low 21 bits of x out to every third bit
+static uint64_t spreadBits(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+// new index of every node in the order of a Morton curve through the bounding box of the positions
+static std::vector<int> mortonOrder(const std::vector<Vector3d> &positions) {
+    Vector3d lo = Vector3d::Constant(std::numeric_limits<double>::max());
+    Vector3d hi = Vector3d::Constant(std::numeric_limits<double>::lowest());
+    for(const Vector3d &p : positions) {
+        lo = lo.cwiseMin(p);
+        hi = hi.cwiseMax(p);
+    }
+    double scale = ((1 << 21) - 1) / std::max((hi - lo).maxCoeff(), std::numeric_limits<double>::min());
+
+    std::vector<std::pair<uint64_t, int>> codes(positions.size());
+    for(int i = 0; i < positions.size(); i++) {
+        Vector3d q = (positions[i] - lo)*scale;
+        codes[i] = {spreadBits(uint64_t(q.x())) | spreadBits(uint64_t(q.y())) << 1 | spreadBits(uint64_t(q.z())) << 2, i};
+    }
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<int> new_index(positions.size());
+    for(int k = 0; k < codes.size(); k++) {
+        new_index[codes[k].second] = k;
+    }
+    return new_index;
+}
+
+void MeshAsset::reorder(std::vector<Vector3d> &positions, std::vector<Vector4i> &tets, MeshOrder order) {
+    if(order == MeshOrder::File) return;
+
+    std::vector<int> new_index = order == MeshOrder::CuthillMcKee ? cuthillMcKee(positions.size(), tets) : mortonOrder(positions);
+
+    std::vector<Vector3d> old_positions = positions;
+    for(int i = 0; i < positions.size(); i++) {
+        positions[new_index[i]] = old_positions[i];
+    }
+
+    for(Vector4i &tet : tets) {
+        for(int k = 0; k < 4; k++) {
+            tet[k] = new_index[tet[k]];
+        }
+    }
+    std::stable_sort(tets.begin(), tets.end(), [](const Vector4i &a, const Vector4i &b) {
+        return a.minCoeff() < b.minCoeff();
+    });
+}
+
+// the value of key in values, made by the first caller while later callers of that key wait for it. the lock is only
+// held to look the key up, so callers of other keys make theirs at the same time
+template<typename Key, typename Value, typename Make>
+static Value makeOnce(std::map<Key, std::shared_future<Value>> &values, std::mutex &mutex, const Key &key, Make make) {
+    std::promise<Value> promise;
+    std::shared_future<Value> made;
+    bool first = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = values.find(key);
+        if(it != values.end()) {
+            made = it->second;
+        } else {
+            made = promise.get_future().share();
+            values.emplace(key, made);
+            first = true;
+        }
+    }
+    if(!first) return made.get();
+
+    Value value = make();
+    promise.set_value(value);
+    return value;
+}
+
+// like makeOnce, but values are only held weakly: everyone asking for key while some caller still holds its value
+// shares it, and it is freed once the last of them lets go. asking after that makes it again
+template<typename Key, typename Value, typename Make>
+static std::shared_ptr<Value> shareWhileHeld(std::map<Key, std::shared_future<std::weak_ptr<Value>>> &values, std::mutex &mutex, const Key &key, Make make) {
+    while(true) {
+        std::promise<std::weak_ptr<Value>> promise;
+        std::shared_future<std::weak_ptr<Value>> made;
+        bool first = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = values.find(key);
+            if(it != values.end() && it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                made = it->second;
+            } else if(it != values.end()) {
+                if(std::shared_ptr<Value> value = it->second.get().lock()) return value;
+            }
+            if(!made.valid()) {
+                made = promise.get_future().share();
+                values[key] = made;
+                first = true;
+            }
+        }
+
+        if(first) {
+            std::shared_ptr<Value> value = make();
+            promise.set_value(value);
+            return value;
+        }
+        // the maker may already have let go of it, then look again
+        if(std::shared_ptr<Value> value = made.get().lock()) return value;
+    }
+}
+
+std::shared_ptr<const MeshAsset> MeshAsset::load(const std::string &filepath, const Matrix4d &transform, double density, MeshOrder order,
+                                                  int lattice_resolution, Vector3d &offset, const std::string &cache_dir) {
+    struct Mesh {
+        std::vector<Vector3d> vertices;
+        std::vector<Vector4i> tets;
+    };
+    static std::mutex mutex;
+    // raw meshes are only kept while assets of them are being built, the assets are all that later loads need
+    static std::map<std::pair<std::string, int>, std::shared_future<std::weak_ptr<const Mesh>>> files;
+    static std::map<std::pair<std::string, std::vector<double>>, std::shared_future<std::shared_ptr<const MeshAsset>>> assets;
+
+    // an affine transform's translation moves the object, not the shape. a projective one is kept whole
+    Matrix4d shape_transform = transform;
+    offset = Vector3d(0,0,0);
+    if(transform.row(3) == RowVector4d(0, 0, 0, 1)) {
+        offset = transform.block<3,1>(0,3);
+        shape_transform.block<3,1>(0,3).setZero();
+    }
+
+    std::pair<std::string, std::vector<double>> key(filepath, std::vector<double>(shape_transform.data(), shape_transform.data() + 16));
+    key.second.push_back(density);
+    key.second.push_back(int(order));
+    key.second.push_back(lattice_resolution);
+
+    return makeOnce(assets, mutex, key, [&]() -> std::shared_ptr<const MeshAsset> {
+        // the cache file is keyed by the contents of every file the mesh is read from, so editing the mesh never brings
+        // back a stale asset
+        std::string cache_path;
+        uint64_t cache_key = 0xcbf29ce484222325ull;
+        if(!cache_dir.empty()) {
+            bool sources_open = true;
+            for(const std::string &source_path : MeshLoader::sourceFiles(filepath)) {
+                MappedFile source(source_path);
+                sources_open = sources_open && source.isOpen();
+                cache_key = hashBytes(source.data(), source.size(), cache_key);
+            }
+            if(sources_open) {
+                cache_key = hashBytes(shape_transform.data(), 16*sizeof(double), cache_key);
+                cache_key = hashBytes(&density, sizeof(double), cache_key);
+                cache_key = hashBytes(&order, sizeof(order), cache_key);
+                cache_key = hashBytes(&lattice_resolution, sizeof(lattice_resolution), cache_key);
+
+                char name[17];
+                std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)cache_key);
+                cache_path = cache_dir + "/" + std::filesystem::path(filepath).stem().string() + "-" + name + ".asset";
+
+                if(std::shared_ptr<const MeshAsset> cached = readCache(cache_path, cache_key)) {
+                    return cached;
+                }
+            }
+        }
+
+        std::shared_ptr<const Mesh> file = shareWhileHeld(files, mutex, std::make_pair(filepath, lattice_resolution), [&]() -> std::shared_ptr<const Mesh> {
+            auto mesh = std::make_shared<Mesh>();
+            if(!MeshLoader::loadTetMesh(filepath, mesh->vertices, mesh->tets, lattice_resolution)) return nullptr;
+            return mesh;
+        });
+        if(!file) return nullptr;
+
+        std::vector<Vector3d> positions = file->vertices;
+        for(Vector3d &p : positions) {
+            Vector4d h_point = shape_transform * Vector4d(p.x(), p.y(), p.z(), 1.0);
+            p = h_point.head<3>() / h_point.w();
+        }
+
+        std::vector<Vector4i> tets = file->tets;
+        reorder(positions, tets, order);
+
+        std::shared_ptr<const MeshAsset> asset = build(positions, tets, density);
+
+        if(!cache_path.empty()) {
+            std::error_code error;
+            std::filesystem::create_directories(cache_dir, error);
+            if(!writeCache(cache_path, cache_key, *asset)) {
+                std::cout << "Error writing mesh cache: " << cache_path << std::endl;
+            }
+        }
+        return asset;
+    });
+}
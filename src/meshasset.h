@@ -0,0 +1,77 @@
+#ifndef MESHASSET_H
+#define MESHASSET_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Eigen/Dense"
+
+// how the nodes and tets of a mesh are numbered. File keeps the file's order, the others renumber nodes so that the
+// nodes of a tet sit close together in memory, by reverse Cuthill-McKee on the node graph or along a Morton curve
+// through the rest positions, and then sort tets by their lowest node
+enum class MeshOrder {
+    File,
+    CuthillMcKee,
+    Morton
+};
+
+// everything about a tet mesh that stays the same while it is simulated: connectivity, surface, rest shape and masses.
+// it is built once and shared read only by every FEMObject made from it, which only keep their own nodes' state.
+// rest positions are in the mesh's own frame, an object sits at an offset from them
+struct MeshAsset {
+    std::vector<Eigen::Vector3d> rest_positions;
+    std::vector<Eigen::Vector4i> tets;
+    std::vector<double> masses;
+    std::vector<double> inverse_masses;
+
+    // tets with the same rest shape up to translation, like all the cubes of a lattice, share its data, tet t's is
+    // betas[tet_shapes[t]] and tet_normals[tet_shapes[t]]
+    std::vector<int> tet_shapes;
+    // first three columns of the inverse of the rest shape matrix [x0 x1 x2 x3; 1 1 1 1], the last one never
+    // contributes to dx/du
+    std::vector<Eigen::Matrix<double, 4, 3>> betas;
+    // column i is the area weighted normal of the three faces of the tet around its vertex i, at rest
+    std::vector<Eigen::Matrix<double, 3, 4>> tet_normals;
+
+    // tets are stored in blocks of neighbouring tets, small enough for a block's data to stay in cache while its forces
+    // are summed, and blocks can be summed on different threads. block b is tets block_offsets[b] to block_offsets[b+1].
+    // nodes only touched by one block's tets are written by it directly, boundary nodes get a slot per block touching
+    // them instead. tet_slots[t][i] is the node vertex i of tet t writes to, or -1-s for slot s, and boundary node j's
+    // slots are boundary_offsets[j] to boundary_offsets[j+1], in block order
+    std::vector<int> block_offsets;
+    std::vector<Eigen::Vector4i> tet_slots;
+    std::vector<int> boundary_nodes;
+    std::vector<int> boundary_offsets;
+
+    std::vector<Eigen::Vector3i> surface_faces;
+    // sorted, only surface nodes can touch a collider
+    std::vector<int> surface_nodes;
+    // sorted, each with the lower node first
+    std::vector<Eigen::Vector2i> surface_edges;
+    // surface node k and its neighbours are ring[ring_offsets[k]] to ring[ring_offsets[k+1]], sorted
+    std::vector<int> ring_offsets;
+    std::vector<int> ring;
+
+    // precomputes everything from rest positions and tets
+    static std::shared_ptr<const MeshAsset> build(const std::vector<Eigen::Vector3d> &rest_positions, const std::vector<Eigen::Vector4i> &tets, double density);
+
+    // renumbers the nodes and tets of a mesh in the given order
+    static void reorder(std::vector<Eigen::Vector3d> &positions, std::vector<Eigen::Vector4i> &tets, MeshOrder order);
+
+    // the asset of a mesh file with transform applied and numbered in order, made once per process for each file,
+    // transform, density, order and lattice resolution (which only .obj surfaces use, see MeshLoader) and shared after
+    // that. translation is left out of the asset and returned in offset, so objects that only differ in where they are
+    // placed share one. safe to call from several threads, which build different assets at the same time and wait for
+    // each other on the same one. returns null if the file does not load.
+    // unless cache_dir is empty, assets are also kept there as binary files named after a hash of the mesh file's
+    // contents and the other keys, and read back from there instead of being built in later runs
+    static std::shared_ptr<const MeshAsset> load(const std::string &filepath, const Eigen::Matrix4d &transform, double density, MeshOrder order,
+                                                 int lattice_resolution, Eigen::Vector3d &offset, const std::string &cache_dir = "");
+
+    // the binary cache files. read fails if the file is missing, from another version or for another key
+    static std::shared_ptr<const MeshAsset> readCache(const std::string &path, uint64_t key);
+    static bool writeCache(const std::string &path, uint64_t key, const MeshAsset &asset);
+};
+
+#endif // MESHASSET_H
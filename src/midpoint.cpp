@@ -0,0 +1,29 @@
+#include "midpoint.h"
+
+void midpointMethod(FEMSystem &system, double delta_t) {
+    VectorXd currentState = system.getState();
+    VectorXd currentDerivative = system.evalDerivative();
+
+    VectorXd midpointState = currentState+currentDerivative*delta_t/2;
+    system.setState(midpointState);
+    VectorXd midpointDerivative = system.evalDerivative();
+
+    VectorXd finalState = currentState+midpointDerivative*delta_t;
+    system.setState(finalState);
+}
+
+void ccdMidpointMethod(FEMSystem &system, double delta_t, int max_subdivisions) {
+    VectorXd startState = system.getState();
+    system.beginSweep();
+    midpointMethod(system, delta_t);
+
+    if(system.timeOfImpact(startState) > 1) return;
+
+    if(max_subdivisions > 0) {
+        system.setState(startState);
+        ccdMidpointMethod(system, delta_t/2, max_subdivisions-1);
+        ccdMidpointMethod(system, delta_t/2, max_subdivisions-1);
+    } else {
+        system.clampToImpact(startState);
+    }
+}
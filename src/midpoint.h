@@ -3,16 +3,10 @@
 
 #include "femsystem.h"
 
-void midpointMethod(FEMSystem &system, double delta_t) {
-    VectorXd currentState = system.getState();
-    VectorXd currentDerivative = system.evalDerivative();
+void midpointMethod(FEMSystem &system, double delta_t);
 
-    VectorXd midpointState = currentState+currentDerivative*delta_t/2;
-    system.setState(midpointState);
-    VectorXd midpointDerivative = system.evalDerivative();
-
-    VectorXd finalState = currentState+midpointDerivative*delta_t;
-    system.setState(finalState);
-}
+// a midpoint step that is redone as two half steps whenever something tunnels through a collider's
+// penalty layer. after max_subdivisions halvings the objects that still tunnel are clamped at the impact
+void ccdMidpointMethod(FEMSystem &system, double delta_t, int max_subdivisions);
 
 #endif // MIDPOINT_H
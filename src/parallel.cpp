@@ -0,0 +1,122 @@
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+thread_local bool t_in_pool = false;
+
+class ThreadPool
+{
+public:
+    ThreadPool() {
+        int n = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        for(int i = 0; i < n; i++) {
+            m_workers.emplace_back([this] {work();});
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for(std::thread &t : m_workers) {
+            t.join();
+        }
+    }
+
+    int size() {return m_workers.size() + 1;}
+
+    void run(int n, int grain, const std::function<void(int, int)> &body) {
+        // one job at a time, callers from different threads take turns
+        std::lock_guard<std::mutex> job(m_job_mutex);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_body = &body;
+            m_n = n;
+            m_grain = grain;
+            m_next = 0;
+            m_busy = m_workers.size();
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        t_in_pool = true;
+        runChunks();
+        t_in_pool = false;
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this] {return m_busy == 0;});
+        m_body = nullptr;
+    }
+
+private:
+    void runChunks() {
+        int begin;
+        while((begin = m_next.fetch_add(m_grain)) < m_n) {
+            (*m_body)(begin, std::min(begin + m_grain, m_n));
+        }
+    }
+
+    void work() {
+        t_in_pool = true;
+        unsigned long seen = 0;
+        while(true) {
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_wake.wait(lock, [&] {return m_stop || m_generation != seen;});
+                if(m_stop) return;
+                seen = m_generation;
+            }
+
+            runChunks();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(--m_busy == 0) m_done.notify_one();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_job_mutex;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+
+    const std::function<void(int, int)> *m_body = nullptr;
+    int m_n = 0;
+    int m_grain = 1;
+    std::atomic<int> m_next = 0;
+    int m_busy = 0;
+    unsigned long m_generation = 0;
+    bool m_stop = false;
+};
+
+ThreadPool &pool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+}
+
+int threadCount() {
+    return pool().size();
+}
+
+void parallelFor(int n, int grain, const std::function<void(int, int)> &body) {
+    grain = std::max(grain, 1);
+    if(n <= 0) return;
+
+    if(t_in_pool || n <= grain || threadCount() == 1) {
+        body(0, n);
+        return;
+    }
+
+    pool().run(n, grain, body);
+}
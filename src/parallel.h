@@ -0,0 +1,13 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <functional>
+
+// number of threads parallelFor spreads work over, including the calling thread
+int threadCount();
+
+// runs body(begin, end) over chunks of [0, n) of at most grain items on a shared pool of worker threads, and
+// returns once every chunk is done. calls made from inside a chunk run serially on the calling thread
+void parallelFor(int n, int grain, const std::function<void(int, int)> &body);
+
+#endif // PARALLEL_H
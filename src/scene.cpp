@@ -0,0 +1,390 @@
+#include "scene.h"
+#include "meshasset.h"
+#include "midpoint.h"
+#include "graphics/meshloader.h"
+#include "heightfield.h"
+#include "parallel.h"
+
+#include <QSettings>
+#include <QStringList>
+#include <QDebug>
+#include <iostream>
+#include <optional>
+
+using namespace Eigen;
+
+void Scene::load(QString config, const std::map<std::string, std::string> &overrides)
+{
+    m_system = FEMSystem();
+    m_meshes.clear();
+
+    QSettings settings(config, QSettings::IniFormat );
+
+    // overrides win over the file. like QSettings, a value with commas in it reads as a list
+    auto contains = [&](const std::string &key) {
+        return overrides.count(key) || settings.contains(QString::fromStdString(key));
+    };
+    auto value = [&](const std::string &key, const QVariant &fallback = QVariant()) {
+        auto it = overrides.find(key);
+        if(it == overrides.end()) return settings.value(QString::fromStdString(key), fallback);
+
+        QString text = QString::fromStdString(it->second);
+        if(!text.contains(',')) return QVariant(text);
+
+        QStringList list = text.split(',');
+        for(QString &item : list) {
+            item = item.trimmed();
+        }
+        return QVariant(list);
+    };
+    if(contains("Global/timestep")) {
+        m_timestep = value("Global/timestep").toDouble();
+    } else {
+        m_timestep = .0003;
+    }
+
+    double grav;
+    if(contains("Global/gravity")) {
+        grav = value("Global/gravity").toDouble();
+    } else {
+        grav = 1;
+    }
+
+    double collision_penalty;
+    if(contains("Global/collision_penalty")) {
+        collision_penalty = value("Global/collision_penalty").toDouble();
+    } else {
+        collision_penalty = 8e7;
+    }
+
+    double collision_epsilon;
+    if(contains("Global/collision_epsilon")) {
+        collision_epsilon = value("Global/collision_epsilon").toDouble();
+    } else {
+        collision_epsilon = .005;
+    }
+
+    ContactMode contact_mode = ContactMode::Penalty;
+    if(contains("Global/contact_mode")) {
+        QString mode = value("Global/contact_mode").toString();
+        if(mode == "projection") {
+            contact_mode = ContactMode::Projection;
+        } else if(mode != "penalty") {
+            qWarning() << "Error: contact_mode must be penalty or projection.";
+        }
+    }
+
+    if(contains("Global/ccd")) {
+        m_ccd = value("Global/ccd").toBool();
+    } else {
+        m_ccd = false;
+    }
+
+    if(contains("Global/ccd_subdivisions")) {
+        m_ccd_subdivisions = value("Global/ccd_subdivisions").toInt();
+    } else {
+        m_ccd_subdivisions = 4;
+    }
+
+    if(contains("Global/report_stats")) {
+        m_report_stats = value("Global/report_stats").toBool();
+    } else {
+        m_report_stats = false;
+    }
+
+    if(contains("Global/frame_budget_ms")) {
+        m_frame_budget = value("Global/frame_budget_ms").toDouble()/1000;
+    } else {
+        m_frame_budget = 1.0/60;
+    }
+
+    std::string mesh_cache_dir;
+    if(contains("Global/mesh_cache_dir")) {
+        mesh_cache_dir = value("Global/mesh_cache_dir").toString().toStdString();
+    } else {
+        mesh_cache_dir = "mesh-cache";
+    }
+
+    MeshOrder mesh_order = MeshOrder::File;
+    if(contains("Global/reorder")) {
+        QString order = value("Global/reorder").toString();
+        if(order == "rcm") {
+            mesh_order = MeshOrder::CuthillMcKee;
+        } else if(order == "morton") {
+            mesh_order = MeshOrder::Morton;
+        } else if(order != "none") {
+            qWarning() << "Error: reorder must be none, rcm or morton.";
+        }
+    }
+
+    // the settings of every object are read first, then the objects are loaded and set up on the thread pool, since
+    // none of them depends on another, and last added to the system in the order of the file
+    struct ObjectConfig {
+        std::string meshfile;
+        std::string render_mesh;
+        Eigen::Matrix4d transform;
+        double density;
+        int lattice_resolution;
+        Properties props;
+        bool is_collider;
+        bool simulate;
+    };
+    std::vector<ObjectConfig> configs;
+
+    for(int obj_idx = 0; contains("Object"+std::to_string(obj_idx)+"/meshfile"); obj_idx++) {
+        ObjectConfig config;
+        Properties &props = config.props;
+        std::string current_object = "Object"+std::to_string(obj_idx);
+
+        // read transformation
+        Eigen::Matrix4d transformationMatrix = Eigen::Matrix4d::Identity();
+        if(contains(current_object+"/transform")) {
+            QStringList matrixStr = value(current_object+"/transform").toStringList();
+
+            if (matrixStr.size() != 16) {
+                qWarning() << "Error: Transformation matrix must have 16 values.";
+            } else {
+                for (int i = 0; i < 4; ++i) {
+                    for (int j = 0; j < 4; ++j) {
+                        transformationMatrix(i, j) = matrixStr[i * 4 + j].toDouble();
+                    }
+                }
+            }
+        }
+        config.transform = transformationMatrix;
+
+        if(contains(current_object+"/density")) {
+            config.density = value(current_object+"/density").toDouble();
+        } else {
+            config.density = 1200;
+        }
+
+        config.meshfile = value(current_object+"/meshfile").toString().toStdString();
+        if(contains(current_object+"/lattice_resolution")) {
+            config.lattice_resolution = value(current_object+"/lattice_resolution").toInt();
+        } else {
+            config.lattice_resolution = 20;
+        }
+        if(contains(current_object+"/render_mesh")) {
+            config.render_mesh = value(current_object+"/render_mesh").toString().toStdString();
+        }
+
+        props.gravity = grav;
+        props.collision_penalty = collision_penalty;
+        props.collision_epsilon = collision_epsilon;
+
+        if(contains(current_object+"/self_collision")) {
+            props.self_collision = value(current_object+"/self_collision").toBool();
+        } else {
+            props.self_collision = false;
+        }
+
+        if(contains(current_object+"/velocity")) {
+            QStringList vectorStr = value(current_object+"/velocity").toStringList();
+            props.initial_velocity = Vector3d(0,0,0);
+            if (vectorStr.size() != 3) {
+                qWarning() << "Error: Velocity must have 3 values.";
+            } else {
+                props.initial_velocity[0] = vectorStr[0].toDouble();
+                props.initial_velocity[1] = vectorStr[1].toDouble();
+                props.initial_velocity[2] = vectorStr[2].toDouble();
+            }
+        } else {
+            props.initial_velocity = Vector3d(0,0,0);
+        }
+
+        if(contains(current_object+"/incompressibility")) {
+            props.incompressibility = value(current_object+"/incompressibility").toDouble();
+        } else {
+            props.incompressibility = 40000;
+        }
+
+        if(contains(current_object+"/rigidity")) {
+            props.rigidity = value(current_object+"/rigidity").toDouble();
+        } else {
+            props.rigidity = 40000;
+        }
+
+        if(contains(current_object+"/viscosity_1")) {
+            props.viscosity_1 = value(current_object+"/viscosity_1").toDouble();
+        } else {
+            props.viscosity_1 = 100;
+        }
+
+        if(contains(current_object+"/viscosity_2")) {
+            props.viscosity_2 = value(current_object+"/viscosity_2").toDouble();
+        } else {
+            props.viscosity_2 = 100;
+        }
+
+        config.is_collider = contains(current_object+"/is_collider") && value(current_object+"/is_collider").toBool();
+        config.simulate = contains(current_object+"/simulate") && value(current_object+"/simulate").toBool();
+
+        configs.push_back(config);
+    }
+
+    struct LoadedObject {
+        bool loaded = false;
+        SceneMesh mesh;
+        std::shared_ptr<Collider> collider;
+        std::optional<FEMObject> object;
+    };
+    std::vector<LoadedObject> loaded(configs.size());
+
+    parallelFor(configs.size(), 1, [&](int begin, int end) {
+        for(int obj_idx = begin; obj_idx < end; obj_idx++) {
+            const ObjectConfig &config = configs[obj_idx];
+            LoadedObject &result = loaded[obj_idx];
+
+            // every object with the same mesh file, shape and density shares one asset, placed at its own offset
+            Vector3d offset;
+            std::shared_ptr<const MeshAsset> asset = MeshAsset::load(config.meshfile, config.transform, config.density, mesh_order, config.lattice_resolution,
+                                                                     offset, mesh_cache_dir);
+            if (!asset) continue;
+
+            std::vector<Vector3d> vertices;
+            vertices.reserve(asset->rest_positions.size());
+            for(const Vector3d &v : asset->rest_positions) {
+                vertices.push_back(v + offset);
+            }
+
+            if(config.is_collider) {
+                result.collider = std::make_shared<Collider>(vertices, asset->surface_faces, obj_idx, false, collision_penalty, collision_epsilon);
+            }
+
+            if(config.simulate) {
+                if(result.collider) {
+                    result.object.emplace(asset, offset, config.props, result.collider);
+                } else {
+                    result.object.emplace(asset, offset, config.props);
+                }
+            }
+
+            // a render surface is transformed like the mesh and bound to it where they both are at rest
+            std::vector<Vector3d> render_vertices;
+            std::vector<Vector3i> render_faces;
+            if(!config.render_mesh.empty() && MeshLoader::loadTriMesh(config.render_mesh, render_vertices, render_faces)) {
+                for(Vector3d &v : render_vertices) {
+                    Vector4d h_point = config.transform * Vector4d(v.x(), v.y(), v.z(), 1.0);
+                    v = h_point.head<3>() / h_point.w();
+                }
+                Embedding embedding = Embedding::bind(vertices, asset->tets, render_vertices);
+                result.mesh = SceneMesh{std::move(render_vertices), std::move(render_faces), {}, -1, std::move(embedding)};
+            } else {
+                result.mesh = SceneMesh{std::move(vertices), asset->surface_faces, asset->tets, -1};
+            }
+            result.loaded = true;
+        }
+    });
+
+    for(LoadedObject &result : loaded) {
+        if(!result.loaded) continue;
+
+        if(result.collider) {
+            m_system.addCollider(result.collider);
+        }
+
+        if(result.object) {
+            result.mesh.object = m_system.getObjectCount();
+            m_system.addObject(*result.object);
+        }
+        m_meshes.push_back(std::move(result.mesh));
+    }
+
+    // ground
+    std::vector<Vector3d> groundVerts;
+    std::vector<Vector3i> groundFaces;
+    groundVerts.emplace_back(-5, 0, -5);
+    groundVerts.emplace_back(-5, 0, 5);
+    groundVerts.emplace_back(5, 0, 5);
+    groundVerts.emplace_back(5, 0, -5);
+    groundFaces.emplace_back(0, 1, 2);
+    groundFaces.emplace_back(0, 2, 3);
+    Collider ground_collider(groundVerts, groundFaces, -1, true, collision_penalty, collision_epsilon);
+    m_system.addCollider(std::make_shared<Collider>(ground_collider));
+    m_meshes.push_back(SceneMesh{groundVerts, groundFaces, {}, -1});
+
+    for(int terrain_idx = 0; contains("Terrain"+std::to_string(terrain_idx)+"/heightmap"); terrain_idx++) {
+        std::string current_terrain = "Terrain"+std::to_string(terrain_idx);
+
+        // only needed for raw heightmaps, PGMs carry their own size
+        int width = value(current_terrain+"/width", 0).toInt();
+        int depth = value(current_terrain+"/depth", 0).toInt();
+
+        std::vector<double> heights;
+        QString heightmap = value(current_terrain+"/heightmap").toString();
+        if(!HeightfieldCollider::loadHeightmap(heightmap.toStdString(), width, depth, heights)) continue;
+
+        Vector3d origin(0,0,0);
+        if(contains(current_terrain+"/origin")) {
+            QStringList vectorStr = value(current_terrain+"/origin").toStringList();
+            if (vectorStr.size() != 3) {
+                qWarning() << "Error: Origin must have 3 values.";
+            } else {
+                origin = Vector3d(vectorStr[0].toDouble(), vectorStr[1].toDouble(), vectorStr[2].toDouble());
+            }
+        }
+
+        double cell_size;
+        if(contains(current_terrain+"/cell_size")) {
+            cell_size = value(current_terrain+"/cell_size").toDouble();
+        } else {
+            cell_size = 1;
+        }
+
+        double height_scale;
+        if(contains(current_terrain+"/height_scale")) {
+            height_scale = value(current_terrain+"/height_scale").toDouble();
+        } else {
+            height_scale = 1;
+        }
+
+        for(double &h : heights) {
+            h *= height_scale;
+        }
+
+        // ids below the ground's -1 so they never match an object's
+        std::shared_ptr<HeightfieldCollider> terrain = std::make_shared<HeightfieldCollider>(heights, width, depth, origin, cell_size, -2 - terrain_idx, collision_penalty, collision_epsilon);
+        m_system.addCollider(terrain);
+
+        SceneMesh mesh;
+        mesh.object = -1;
+        terrain->getMesh(mesh.vertices, mesh.faces);
+        m_meshes.push_back(mesh);
+    }
+
+    m_has_camera_position = false;
+    if(contains("Global/camera_pos")) {
+        QStringList vectorStr = value("Global/camera_pos").toStringList();
+        if (vectorStr.size() != 3) {
+            qWarning() << "Error: Velocity must have 3 values.";
+        } else {
+            m_has_camera_position = true;
+            m_camera_position = Vector3d(vectorStr[0].toDouble(), vectorStr[1].toDouble(), vectorStr[2].toDouble());
+        }
+    }
+
+    m_system.setContactMode(contact_mode);
+    m_system.init();
+}
+
+void Scene::step()
+{
+    if(m_ccd) {
+        ccdMidpointMethod(m_system, m_timestep, m_ccd_subdivisions);
+    } else {
+        midpointMethod(m_system, m_timestep);
+    }
+    m_system.projectContacts();
+}
+
+void Scene::printStats()
+{
+    const FEMSystem::Stats &stats = m_system.getStats();
+    if(stats.evaluations > 0) {
+        std::cout << stats.evaluations << " evaluations, " << double(stats.contacts)/stats.evaluations << " contacts, "
+                  << 1e3*stats.detect_seconds/stats.evaluations << " ms detection, "
+                  << 1e3*stats.assembly_seconds/stats.evaluations << " ms assembly per evaluation" << std::endl;
+    }
+    m_system.resetStats();
+}
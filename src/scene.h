@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QString>
+#include <map>
+#include <string>
+#include "embedding.h"
+#include "femsystem.h"
+
+// a mesh of the scene to draw. object is the index of the FEMObject that moves it, or -1 if it never moves. unless
+// embedding is empty, vertices and faces are a separate render surface whose vertices the object's nodes place
+// through it, and the mesh has no tets to draw
+struct SceneMesh {
+    std::vector<Vector3d> vertices;
+    std::vector<Vector3i> faces;
+    std::vector<Vector4i> tets;
+    int object;
+    Embedding embedding;
+};
+
+// the objects, colliders and integrator settings of a config (.ini) file. needs nothing but Qt Core,
+// so it runs the same in the GUI and in the headless batch runner
+class Scene
+{
+public:
+    // overrides maps "Section/key" to a value used instead of the one in the file
+    void load(QString config, const std::map<std::string, std::string> &overrides = {});
+
+    // one timestep with the configured integrator and contact handling
+    void step();
+
+    // prints the contact and timing stats gathered since the last call
+    void printStats();
+
+    FEMSystem &getSystem() {return m_system;}
+    const std::vector<SceneMesh> &getMeshes() {return m_meshes;}
+    double getTimestep() {return m_timestep;}
+    bool getReportStats() {return m_report_stats;}
+    // wall clock seconds a frame may spend stepping
+    double getFrameBudget() {return m_frame_budget;}
+    bool hasCameraPosition() {return m_has_camera_position;}
+    const Vector3d &getCameraPosition() {return m_camera_position;}
+
+private:
+    double m_timestep;
+    bool m_ccd;
+    int m_ccd_subdivisions;
+    bool m_report_stats;
+    double m_frame_budget;
+    bool m_has_camera_position;
+    Vector3d m_camera_position;
+
+    FEMSystem m_system;
+    std::vector<SceneMesh> m_meshes;
+};
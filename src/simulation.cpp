@@ -1,210 +1,164 @@
 #include "simulation.h"
-#include "graphics/meshloader.h"
-#include "extractfaces.h"
-#include "midpoint.h"
+#include "stepscheduler.h"
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 
 using namespace Eigen;
 
-Simulation::Simulation(QString config) : m_config(config) {}
+Simulation::Simulation(QString config) : m_config(config), m_running(false) {}
 
-void Simulation::init(Camera &camera)
+Simulation::~Simulation()
 {
-    m_system = FEMSystem();
+    stop();
+}
 
-    QSettings settings(m_config, QSettings::IniFormat );
-    if(settings.contains("Global/timestep")) {
-        m_timestep = settings.value("Global/timestep").toDouble();
-    } else {
-        m_timestep = .0003;
-    }
+void Simulation::init(Camera &camera)
+{
+    stop();
+    m_scene.load(m_config);
+    m_timestep = m_scene.getTimestep();
+    m_recording_previous = false;
+
+    m_shapes.clear();
+    m_object_shapes.assign(m_scene.getSystem().getObjectCount(), -1);
+    for(const SceneMesh &mesh : m_scene.getMeshes()) {
+        Shape shape;
+        if(mesh.tets.empty()) {
+            shape.init(mesh.vertices, mesh.faces);
+        } else {
+            shape.init(mesh.vertices, mesh.faces, mesh.tets);
+        }
 
-    double grav;
-    if(settings.contains("Global/gravity")) {
-        grav = settings.value("Global/gravity").toDouble();
-    } else {
-        grav = 1;
+        if(mesh.object >= 0) {
+            m_object_shapes[mesh.object] = m_shapes.size();
+        }
+        m_shapes.push_back(shape);
     }
 
-    double collision_penalty;
-    if(settings.contains("Global/collision_penalty")) {
-        collision_penalty = settings.value("Global/collision_penalty").toDouble();
-    } else {
-        collision_penalty = 8e7;
-    }
+    m_scene.getSystem().addObserver(this);
 
-    double collision_epsilon;
-    if(settings.contains("Global/collision_epsilon")) {
-        collision_epsilon = settings.value("Global/collision_epsilon").toDouble();
-    } else {
-        collision_epsilon = .005;
+    if(m_scene.hasCameraPosition()) {
+        camera.setPosition(m_scene.getCameraPosition().cast<float>());
     }
 
-    for(int obj_idx = 0; settings.contains("Object"+std::to_string(obj_idx)+"/meshfile"); obj_idx++) {
-        std::vector<Vector3d> vertices;
-        std::vector<Vector4i> tets;
-        Properties props;
-        std::string current_object = "Object"+std::to_string(obj_idx);
-
-        QString meshFile = settings.value(current_object+"/meshfile").toString();
-        if (MeshLoader::loadTetMesh(meshFile.toStdString(), vertices, tets)) {
-
-            // read transformation
-            if(settings.contains(current_object+"/transform")) {
-                QStringList matrixStr = settings.value(current_object+"/transform").toStringList();
-
-                if (matrixStr.size() != 16) {
-                    qWarning() << "Error: Transformation matrix must have 16 values.";
-                } else {
-                    Eigen::Matrix4d transformationMatrix;
-
-                    for (int i = 0; i < 4; ++i) {
-                        for (int j = 0; j < 4; ++j) {
-                            transformationMatrix(i, j) = matrixStr[i * 4 + j].toDouble();
-                        }
-                    }
-
-                    for(int i = 0; i < vertices.size(); i++) {
-                        Vector4d h_point(vertices[i].x(), vertices[i].y(), vertices[i].z(), 1.0);
-                        h_point = transformationMatrix * h_point;
-                        vertices[i] = h_point.head<3>()/ h_point.w();
-                    }
-                }
-            }
-
-            props.gravity = grav;
-
-            if(settings.contains(current_object+"/velocity")) {
-                QStringList vectorStr = settings.value(current_object+"/velocity").toStringList();
-                props.initial_velocity = Vector3d(0,0,0);
-                if (vectorStr.size() != 3) {
-                    qWarning() << "Error: Velocity must have 3 values.";
-                } else {
-                    props.initial_velocity[0] = vectorStr[0].toDouble();
-                    props.initial_velocity[1] = vectorStr[1].toDouble();
-                    props.initial_velocity[2] = vectorStr[2].toDouble();
-                }
-            } else {
-                props.initial_velocity = Vector3d(0,0,0);
-            }
-
-            if(settings.contains(current_object+"/density")) {
-                props.density = settings.value(current_object+"/density").toDouble();
-            } else {
-                props.density = 1200;
-            }
-
-            if(settings.contains(current_object+"/incompressibility")) {
-                props.incompressibility = settings.value(current_object+"/incompressibility").toDouble();
-            } else {
-                props.incompressibility = 40000;
-            }
-
-            if(settings.contains(current_object+"/rigidity")) {
-                props.rigidity = settings.value(current_object+"/rigidity").toDouble();
-            } else {
-                props.rigidity = 40000;
-            }
+    m_running = true;
+    m_thread = std::thread(&Simulation::run, this);
+}
 
-            if(settings.contains(current_object+"/viscosity_1")) {
-                props.viscosity_1 = settings.value(current_object+"/viscosity_1").toDouble();
-            } else {
-                props.viscosity_1 = 100;
-            }
+void Simulation::stop()
+{
+    m_running = false;
+    if(m_thread.joinable()) {
+        m_thread.join();
+    }
+}
 
-            if(settings.contains(current_object+"/viscosity_2")) {
-                props.viscosity_2 = settings.value(current_object+"/viscosity_2").toDouble();
-            } else {
-                props.viscosity_2 = 100;
+// steps the scene to keep up with the clock, within the frame budget, and publishes the vertices after every
+// batch of steps
+void Simulation::run()
+{
+    StepScheduler scheduler(m_scene.getTimestep(), m_scene.getFrameBudget());
+    double seconds_since_report = 0;
+    auto last = std::chrono::steady_clock::now();
+
+    while(m_running) {
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        int n_steps = scheduler.plan(seconds);
+        for(int i = 0; i < n_steps; i++) {
+            if(i == n_steps - 1) {
+                m_recording_previous = true;
+                m_scene.getSystem().notifyObservers();
+                m_recording_previous = false;
             }
+            m_scene.step();
+        }
+        auto stepped = std::chrono::steady_clock::now();
+        scheduler.record(n_steps, std::chrono::duration<double>(stepped - now).count());
+
+        if(n_steps > 0) {
+            m_scene.getSystem().notifyObservers();
+            m_snapshots.back().fraction = scheduler.stepFraction();
+            m_snapshots.back().published = stepped;
+            m_snapshots.publish();
+        } else {
+            std::this_thread::sleep_for(std::chrono::duration<double>(scheduler.timeToNextStep()));
+        }
 
-            std::vector<Vector3i> outsideFaces;
-            std::vector<std::vector<Vector3i>> tetFullFaces;
-            extractFaces(tets, vertices, outsideFaces, tetFullFaces);
-            Shape shape;
-            shape.init(vertices, outsideFaces, tets);
-            m_system.addShape(shape);
-
-            bool use_collider = false;
-            std::shared_ptr<Collider> collider;
-            if(settings.contains(current_object+"/is_collider") && settings.value(current_object+"/is_collider").toBool()) {
-                collider = std::make_shared<Collider>(Collider(vertices, outsideFaces, obj_idx, false, collision_penalty, collision_epsilon));
-
-                use_collider = true;
-                m_system.addCollider(collider);
+        seconds_since_report += seconds;
+        if(seconds_since_report >= 1) {
+            // falling behind is always worth knowing about, the rest only when asked for
+            double factor = scheduler.realTimeFactor();
+            if(factor < 0.95 || m_scene.getReportStats()) {
+                std::cout << "running at " << factor << "x real time" << std::endl;
             }
-
-            if(settings.contains(current_object+"/simulate") && settings.value(current_object+"/simulate").toBool()) {
-                if(use_collider) {
-                    FEMObject object(vertices, tets, tetFullFaces, props, shape, collider);
-                    m_system.addObject(object);
-                } else {
-                    FEMObject object(vertices, tets, tetFullFaces, props, shape);
-                    m_system.addObject(object);
-                }
+            if(m_scene.getReportStats()) {
+                m_scene.printStats();
             }
+            scheduler.resetStats();
+            seconds_since_report = 0;
         }
     }
+}
 
-    // ground
-    std::vector<Vector3d> groundVerts;
-    std::vector<Vector3i> groundFaces;
-    groundVerts.emplace_back(-5, 0, -5);
-    groundVerts.emplace_back(-5, 0, 5);
-    groundVerts.emplace_back(5, 0, 5);
-    groundVerts.emplace_back(5, 0, -5);
-    groundFaces.emplace_back(0, 1, 2);
-    groundFaces.emplace_back(0, 2, 3);
-    Shape ground;
-    ground.init(groundVerts, groundFaces);
-    Collider ground_collider(groundVerts, groundFaces, -1, true, collision_penalty, collision_epsilon);
-    m_system.addCollider(std::make_shared<Collider>(ground_collider));
-    m_system.addShape(ground);
-
-    if(settings.contains("Global/camera_pos")) {
-        QStringList vectorStr = settings.value("Global/camera_pos").toStringList();
-        if (vectorStr.size() != 3) {
-            qWarning() << "Error: Velocity must have 3 values.";
-        } else {
-            camera.setPosition(Vector3f(vectorStr[0].toFloat(), vectorStr[1].toFloat(), vectorStr[2].toFloat()));
-        }
+void Simulation::objectUpdated(int object, const std::vector<Eigen::Vector3d> &vertices)
+{
+    std::vector<std::vector<Eigen::Vector3d>> &objects = m_recording_previous ? m_snapshots.back().previous : m_snapshots.back().current;
+    if(objects.size() <= object) {
+        objects.resize(object + 1);
     }
-
-    m_system.init();
+    objects[object] = vertices;
 }
 
-void Simulation::update(double seconds)
+// draws the objects where they were a step ago plus however far the clock has moved into the following step,
+// which keeps the motion smooth even when a frame falls between steps or the steps are coarser than the frames
+void Simulation::draw(Shader *shader)
 {
-    // STUDENTS: This method should contain all the time-stepping logic for your simulation.
-    //   Specifically, the code you write here should compute new, updated vertex positions for your
-    //   simulation mesh, and it should then call m_shape.setVertices to update the display with those
-    //   newly-updated vertices.
+    m_snapshots.update();
+    const Snapshot &snapshot = m_snapshots.front();
 
-    m_seconds_since_last_step += seconds;
+    if(!snapshot.current.empty()) {
+        double since = std::chrono::duration<double>(std::chrono::steady_clock::now() - snapshot.published).count();
+        double t = std::clamp(snapshot.fraction + since/m_timestep, 0.0, 1.0);
 
-    int n_steps = m_seconds_since_last_step / m_timestep;
-    m_seconds_since_last_step -= n_steps*m_timestep;
+        for(int i = 0; i < snapshot.current.size(); i++) {
+            const std::vector<Eigen::Vector3d> &previous = snapshot.previous[i];
+            const std::vector<Eigen::Vector3d> &current = snapshot.current[i];
 
-    for(int i = 0; i < n_steps; i++) {
-        midpointMethod(m_system, m_timestep);
-    }
+            m_interpolated.resize(current.size());
+            for(int k = 0; k < current.size(); k++) {
+                m_interpolated[k] = (1-t)*previous[k] + t*current[k];
+            }
 
-    m_system.updateVertices();
-}
+            // shapes and scene meshes share their indices
+            const Embedding &embedding = m_scene.getMeshes()[m_object_shapes[i]].embedding;
+            if(embedding.empty()) {
+                m_shapes[m_object_shapes[i]].setVertices(m_interpolated);
+            } else {
+                embedding.apply(m_interpolated, m_embedded);
+                m_shapes[m_object_shapes[i]].setVertices(m_embedded);
+            }
+        }
+    }
 
-void Simulation::draw(Shader *shader)
-{
-    m_system.draw(shader);
+    for(Shape &s : m_shapes) {
+        s.draw(shader);
+    }
 }
 
 void Simulation::toggleWire()
 {
-    m_system.toggleWire();
+    for(Shape &s : m_shapes) {
+        s.toggleWireframe();
+    }
 }
 
 // each stores vertices and faces. lets you update vertices
 // vertices are updated during setstate
 // after loading all objects to system, each object registers list of the other colliders
 // in config, each object can set as a collider or not, and same with whether or not a FEMObject
-// FEMSystem stores separate lists of colliders, objects, shapes to render
+// FEMSystem stores separate lists of colliders and objects, Simulation the shapes to render
@@ -1,28 +1,58 @@
 #pragma once
 
 #include "graphics/shape.h"
-#include <QSettings>
-#include "femsystem.h"
+#include "scene.h"
+#include "triplebuffer.h"
 #include <graphics/camera.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 class Shader;
 
-class Simulation
+// runs the scene on its own thread in real time, and draws the newest vertices it has published
+class Simulation : public FEMObserver
 {
 public:
     Simulation(QString config);
+    ~Simulation();
 
+    // loads the config and starts stepping, needs the GL context for the shapes
     void init(Camera &camera);
 
-    void update(double seconds);
-
     void draw(Shader *shader);
 
     void toggleWire();
+
+    // called on the simulation thread
+    void objectUpdated(int object, const std::vector<Eigen::Vector3d> &vertices) override;
 private:
+    // the node positions of every object before and after the last step of a batch. fraction is how far into the
+    // next step the clock already was when the batch finished, at time published
+    struct Snapshot {
+        std::vector<std::vector<Eigen::Vector3d>> previous;
+        std::vector<std::vector<Eigen::Vector3d>> current;
+        double fraction;
+        std::chrono::steady_clock::time_point published;
+    };
+
+    void run();
+    void stop();
+
     QString m_config;
-    double m_seconds_since_last_step;
+
+    Scene m_scene;
+    std::thread m_thread;
+    std::atomic<bool> m_running;
+    TripleBuffer<Snapshot> m_snapshots;
+    // whether objectUpdated is recording the positions before the last step
+    bool m_recording_previous;
     double m_timestep;
+    std::vector<Eigen::Vector3d> m_interpolated;
+    // the render surface placed by m_interpolated, for objects that have one
+    std::vector<Eigen::Vector3d> m_embedded;
 
-    FEMSystem m_system;
+    std::vector<Shape> m_shapes;
+    // the shape drawing each simulated object
+    std::vector<int> m_object_shapes;
 };
@@ -0,0 +1,40 @@
+#include "stepscheduler.h"
+#include <algorithm>
+#include <cmath>
+
+StepScheduler::StepScheduler(double timestep, double frame_budget) :
+    m_timestep(timestep),
+    m_frame_budget(frame_budget)
+{
+}
+
+int StepScheduler::plan(double seconds) {
+    m_accumulator += seconds;
+    m_elapsed += seconds;
+
+    int n_steps = m_accumulator / m_timestep;
+
+    // a single step until there is a measurement, then as many as the budget allows, but always at least one
+    int max_steps = m_step_cost < 0 ? 1 : std::max(1.0, std::floor(m_frame_budget / m_step_cost));
+    if(n_steps > max_steps) {
+        n_steps = max_steps;
+        // drop the backlog, carrying it over is what makes every following frame even longer
+        m_accumulator = n_steps*m_timestep;
+    }
+
+    m_accumulator -= n_steps*m_timestep;
+    m_simulated += n_steps*m_timestep;
+    return n_steps;
+}
+
+void StepScheduler::record(int steps, double seconds) {
+    if(steps <= 0) return;
+
+    double cost = seconds/steps;
+    m_step_cost = m_step_cost < 0 ? cost : 0.8*m_step_cost + 0.2*cost;
+}
+
+void StepScheduler::resetStats() {
+    m_simulated = 0;
+    m_elapsed = 0;
+}
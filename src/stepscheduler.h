@@ -0,0 +1,35 @@
+#ifndef STEPSCHEDULER_H
+#define STEPSCHEDULER_H
+
+// decides how many fixed timesteps to run for the wall clock time that passed, without ever planning more
+// than fit in the frame budget at the measured cost of a step. time that cannot be caught up on is dropped,
+// so a scene too heavy for real time runs in slow motion instead of falling further behind every frame
+class StepScheduler
+{
+public:
+    StepScheduler(double timestep, double frame_budget);
+
+    // number of steps to run now that seconds of wall clock time have passed since the last call
+    int plan(double seconds);
+    // how long the planned steps took
+    void record(int steps, double seconds);
+
+    // wall clock time until the next step is due
+    double timeToNextStep() {return m_timestep - m_accumulator;}
+    // how far into the next step the clock is, in [0, 1)
+    double stepFraction() {return m_accumulator/m_timestep;}
+    // simulated time over wall clock time since the last resetStats, below 1 when time was dropped
+    double realTimeFactor() {return m_elapsed > 0 ? m_simulated/m_elapsed : 1;}
+    void resetStats();
+
+private:
+    double m_timestep;
+    double m_frame_budget;
+    double m_accumulator = 0;
+    double m_step_cost = -1;  // running average of the seconds a step takes, -1 until the first is measured
+
+    double m_simulated = 0;
+    double m_elapsed = 0;
+};
+
+#endif // STEPSCHEDULER_H
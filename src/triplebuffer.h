@@ -0,0 +1,44 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+// hands values from one writer thread to one reader thread without either ever waiting. the writer fills
+// back() and publishes it, the reader picks up the newest published value with update() and reads front().
+// values published before the reader gets to them are dropped
+template<typename T>
+class TripleBuffer
+{
+public:
+    // writer side
+    T &back() {return m_buffers[m_back];}
+
+    void publish() {
+        // the back buffer becomes the waiting one, and the one that was waiting is written next
+        int old = m_waiting.exchange(m_back | FRESH, std::memory_order_acq_rel);
+        m_back = old & INDEX;
+    }
+
+    // reader side, returns whether front() changed
+    bool update() {
+        if(!(m_waiting.load(std::memory_order_relaxed) & FRESH)) return false;
+
+        int old = m_waiting.exchange(m_front, std::memory_order_acq_rel);
+        m_front = old & INDEX;
+        return true;
+    }
+
+    const T &front() {return m_buffers[m_front];}
+
+private:
+    static const int INDEX = 3;
+    static const int FRESH = 4;
+
+    T m_buffers[3];
+    int m_back = 0;
+    int m_front = 1;
+    // index of the buffer between the two, with FRESH set if the writer put it there since the reader last looked
+    std::atomic<int> m_waiting{2};
+};
+
+#endif // TRIPLEBUFFER_H